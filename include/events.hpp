@@ -0,0 +1,38 @@
+#pragma once
+
+// public API for other mods, eg. replay bots and macro tools. every input CBF applies is posted as an
+// InputAppliedEvent on the game thread, right before it goes to PlayLayer::handleButton, with exactly
+// where inside the physics step it landed. tick based macro formats lose that, so they cant replay CBF
+//
+//     geode::EventListener<geode::EventFilter<cbf::InputAppliedEvent>> listener([](cbf::InputAppliedEvent* event) {
+//         const cbf::AppliedInput& input = event->input;
+//         ...
+//         return geode::ListenerResult::Propagate;
+//     });
+
+#include <stdint.h>
+
+#include <Geode/loader/Event.hpp>
+
+namespace cbf {
+
+struct AppliedInput {
+    uint64_t frame; // physics frames since the game started, counts every frame CBF saw
+    int stepCount; // physics steps in that frame
+    int stepIndex;
+    int subStep; // sub-steps of the same step before the one that ended at the input
+    double stepFraction; // how far into the step, 1 for inputs applied on the step's end
+    double deltaFactor; // share of the step the sub-step that ended at the input took
+    int button; // 1 jump, 2 left, 3 right, like PlayerButton
+    bool down;
+    bool player1;
+};
+
+class InputAppliedEvent : public geode::Event {
+public:
+    explicit InputAppliedEvent(const AppliedInput& input) : input(input) {}
+
+    const AppliedInput input;
+};
+
+}
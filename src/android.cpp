@@ -4,13 +4,14 @@
 #include <time.h>
 
 #include "platform.hpp"
+#include "trace.hpp"
 
 using namespace geode::prelude;
 
 cbf::TimestampType cbf::getCurrentTime() {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
-	return (now.tv_sec * 1000) + (now.tv_nsec / 1'000'000);
+	return cbf::TimestampType(std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec));
 }
 
 void clearJNIExceptions() {
@@ -40,11 +41,32 @@ bool reportPlatformCapability(std::string id) {
 	return false;
 }
 
-cbf::TimestampType g_lastTimestamp;
+cbf::TouchTimestampQueue g_touchTimestamps;
 
+// MotionEvent times are CLOCK_MONOTONIC nanoseconds, same clock as getCurrentTime
+// older launchers only report the time of each event, so it can go to any touch
 void JNICALL JNI_setNextInputTimestamp(JNIEnv* env, jobject, jlong timestamp) {
-	auto timestampMs = timestamp / 1'000'000;
-	g_lastTimestamp = timestampMs;
+	g_touchTimestamps.record(cbf::TouchTimestamp { .time = cbf::TimestampType(cbf::Duration(timestamp)) });
+}
+
+// pointer id and MotionEvent action of the touch the timestamp belongs to
+void JNICALL JNI_setNextInputTimestampForPointer(JNIEnv* env, jobject, jint pointerId, jint action, jlong timestamp) {
+	cbf::TouchAction touchAction;
+	switch (action) {
+	case 0: // ACTION_DOWN
+	case 5: // ACTION_POINTER_DOWN
+		touchAction = cbf::TouchAction::Down;
+		break;
+	case 1: // ACTION_UP
+	case 3: // ACTION_CANCEL
+	case 6: // ACTION_POINTER_UP
+		touchAction = cbf::TouchAction::Up;
+		break;
+	default:
+		return;
+	}
+
+	g_touchTimestamps.record(cbf::TouchTimestamp { cbf::TimestampType(cbf::Duration(timestamp)), pointerId, touchAction });
 }
 
 #include <Geode/modify/CCTouchDispatcher.hpp>
@@ -55,9 +77,17 @@ class $modify(CCTouchDispatcher) {
 		if (index == CCTOUCHBEGAN || index == CCTOUCHENDED) {
 			auto& manager = cbf::Manager::get();
 			auto state = index == CCTOUCHBEGAN ? cbf::InputState::Press : cbf::InputState::Release;
-			// log::debug("input timestamp is {}, state {}", g_lastTimestamp, int(state));
-			manager.addInput(cbf::Input { .time = g_lastTimestamp, .state = state });
-			g_lastTimestamp = 0;
+			auto action = index == CCTOUCHBEGAN ? cbf::TouchAction::Down : cbf::TouchAction::Up;
+			auto now = cbf::getCurrentTime();
+			CBF_TRACE_SCOPE(Input, touches->count());
+
+			// every finger is its own input, touches without a reported timestamp fall back to the receive time
+			for (auto it = touches->begin(); it != touches->end(); ++it) {
+				auto touch = static_cast<CCTouch*>(*it);
+				auto time = g_touchTimestamps.take(touch->getID(), action, now);
+				// log::debug("input timestamp is {}, pointer {}, state {}", time.time_since_epoch().count(), touch->getID(), int(state));
+				manager.engine.addInput(cbf::Input { .time = time, .state = state }, cbf::ClockSource::Touch, now);
+			}
 		}
 	}
 };
@@ -70,6 +100,14 @@ static JNINativeMethod methods[] = {
 	},
 };
 
+static JNINativeMethod pointerMethods[] = {
+	{
+		"setNextInputTimestampForPointer",
+		"(IIJ)V",
+		reinterpret_cast<void*>(&JNI_setNextInputTimestampForPointer)
+	},
+};
+
 $on_mod(Loaded) {
 	auto vm = cocos2d::JniHelper::getJavaVM();
 
@@ -83,5 +121,13 @@ $on_mod(Loaded) {
 		} else {
 			reportPlatformCapability("timestamp_inputs");
 		}
+
+		// registered separately, RegisterNatives fails as a whole if any method is missing
+		if (env->RegisterNatives(clazz, pointerMethods, 1) != 0) {
+			clearJNIExceptions();
+			geode::log::info("the launcher doesn't support per-pointer input timestamps, multi-touch timestamps may be shared");
+		} else {
+			reportPlatformCapability("timestamp_inputs_pointer");
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+// debug logging for the hot paths: the physics hooks and the input thread only record which message
+// it was and its raw arguments, turning that into text happens later on another thread
+// the text is written by the platform side
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include "engine.hpp"
+
+namespace cbf {
+
+enum class LogMessage : uint8_t {
+    SubStep,
+    RawInputTooLarge,
+    Count
+};
+
+// fmt style, each one takes at most LogRecord::maxArgs arguments
+inline constexpr const char* logFormats[] = {
+    "inserting new time step at {:.3f} - delta {:.5f}",
+    "GetRawInputData failed, packet is over {} bytes?",
+};
+static_assert(std::size(logFormats) == size_t(LogMessage::Count));
+
+struct LogRecord {
+    static constexpr size_t maxArgs = 2;
+
+    TimestampType time; // when it was logged, the ring takes batches by time
+    std::array<double, maxArgs> args;
+    LogMessage message;
+};
+
+// one producer thread per log, drained from any thread
+// writes never allocate or block, a full ring drops the message and counts it
+class DeferredLog {
+public:
+    static constexpr size_t capacity = 4096;
+
+    // off skips even the record, so a disabled message costs one relaxed load
+    void setEnabled(bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // producer side
+    void write(LogMessage message, double arg0 = 0.0, double arg1 = 0.0) {
+        if (!isEnabled()) return;
+        ring.push(LogRecord { getCurrentTime(), { arg0, arg1 }, message });
+    }
+
+    // hands everything written so far to fn, oldest first
+    template <typename F>
+    size_t drain(F&& fn) {
+        std::lock_guard lock(drainMutex);
+        const size_t count = ring.takeBatch(TimestampType::max());
+        ring.forEachInBatch(fn);
+        ring.release(ring.batchEnd());
+        return count;
+    }
+
+    uint64_t dropped() const { return ring.overflows(); }
+
+private:
+    SpscRing<LogRecord, capacity> ring;
+    std::atomic<bool> enabled = false;
+    std::mutex drainMutex; // the background flush and an explicit one can overlap
+};
+
+// the thread that turns deferred logs into text, runs flush every interval and once more when stopped
+class LogFlusher {
+public:
+    LogFlusher() = default;
+    ~LogFlusher() { stop(); }
+    LogFlusher(const LogFlusher&) = delete;
+    LogFlusher& operator=(const LogFlusher&) = delete;
+
+    void start(std::chrono::milliseconds interval, std::function<void()> flush) {
+        if (running()) return;
+        stopping = false;
+        thread = std::thread([this, interval, flush = std::move(flush)] {
+            std::unique_lock lock(mutex);
+            while (!wake.wait_for(lock, interval, [&] { return stopping; })) {
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+            lock.unlock();
+            flush();
+        });
+    }
+
+    // waits for the last flush, safe to call when not started
+    void stop() {
+        if (!running()) return;
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    bool running() const { return thread.joinable(); }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
+
+}
@@ -0,0 +1,141 @@
+#include "engine.hpp"
+#include "recording.hpp"
+#include "trace.hpp"
+
+namespace cbf {
+
+void Engine::beginLoop(TimestampType now) {
+	if (cutoffMode == CutoffMode::LoopStart) currentFrameTime = now;
+	cutoffPredictor.beginLoop(now);
+	if (Recorder* active = recorder.load(std::memory_order_relaxed)) active->loop(now, cutoffMode);
+}
+
+void Engine::reset() {
+	if (Recorder* active = recorder.load(std::memory_order_relaxed)) active->reset();
+	firstFrame = true;
+	skipUpdate = true;
+
+	inputQueue.clear();
+	buttonStates.forget();
+	for (auto& timeline : timelines) {
+		timeline.cursor.skipBatch();
+		timeline.nextInput = {};
+		timeline.nextMerged = {};
+		timeline.handedInput = {};
+		timeline.handedMerged = {};
+	}
+}
+
+void Engine::suspend() {
+	if (Recorder* active = recorder.load(std::memory_order_relaxed)) active->suspend();
+	firstFrame = true;
+	skipUpdate = true;
+	buttonStates.forget();
+	for (auto& timeline : timelines) {
+		timeline.nextInput = {};
+		timeline.nextMerged = {};
+		timeline.handedInput = {};
+		timeline.handedMerged = {};
+	}
+}
+
+void Engine::recordInput(Recorder& recorder, size_t lane, const Input& input, TimestampType eventTime, TimestampType receiveTime) {
+	recorder.input(lane, input, eventTime, receiveTime);
+}
+
+void Engine::beginFrame(int stepCount, bool dualMode, TimestampType now) {
+	lastFrameTime = lastPhysicsFrameTime;
+	frameNumber++;
+
+	CBF_TRACE_BEGIN(Drain);
+	// inputs consumed by every timeline last frame go back to the input thread, the rest are handed out
+	// again. a timeline that stopped early (dual mode ending mid frame) only gets back what it hadnt
+	// reached, the other one's inputs stay applied
+	for (int i = 0; i < activeTimelines; i++) timelines[i].cursor.markApplied(appliedInputs);
+	inputQueue.release(std::min(appliedInputs[0], appliedInputs[1]));
+	inputQueue.pin(std::max(appliedInputs[0], appliedInputs[1]));
+
+	// nextInput is kept, an input carried by last frame's final step still has to be applied
+	for (auto& timeline : timelines) {
+		leftoverSteps += timeline.stepGenerator.remainingSteps();
+		timeline.stepGenerator.clear();
+		timeline.subStep = 0;
+	}
+
+	if (cutoffMode == CutoffMode::Physics) currentFrameTime = now;
+	else if (cutoffMode == CutoffMode::Adaptive) currentFrameTime = std::max(cutoffPredictor.cutoff(now), lastPhysicsFrameTime);
+
+	// anything timestamped after the cutoff stays in the ring for the next frame
+	const uint64_t afterCutoff = inputQueue.afterCutoff();
+	inputQueue.takeBatch(currentFrameTime);
+	if (cutoffMode == CutoffMode::Adaptive) cutoffPredictor.deferred(inputQueue.afterCutoff() - afterCutoff);
+	CBF_TRACE_END(Drain, inputQueue.batchEnd() - inputQueue.batchBegin());
+
+	// in dual mode each player gets its own timeline, so it is only sub-stepped at its own inputs
+	if (dualMode) {
+		activeTimelines = 2;
+		timelines[0].cursor.reset(Player::Player1, appliedInputs);
+		timelines[1].cursor.reset(Player::Player2, appliedInputs);
+	}
+	else {
+		// an input p2's timeline placed but didnt get to apply (one its last step carried, or it stopped early) is
+		// already counted as applied, p1's timeline takes it over
+		if (activeTimelines == 2 && timelines[1].nextInput.time != TimestampType {}) {
+			timelines[0].handedInput = timelines[1].nextInput;
+			timelines[0].handedMerged = timelines[1].nextMerged;
+			timelines[0].handedPlacement = timelines[1].nextPlacement;
+		}
+		activeTimelines = 1;
+		timelines[0].cursor.reset(std::nullopt, appliedInputs);
+		timelines[1].nextInput = {};
+		timelines[1].nextMerged = {};
+	}
+
+	lastPhysicsFrameTime = currentFrameTime;
+
+	if (Recorder* active = recorder.load(std::memory_order_relaxed)) {
+		active->frame(now, cutoffMode, RecordedFrame {
+			.currentFrameTime = currentFrameTime,
+			.lastFrameTime = lastFrameTime,
+			.stepCount = stepCount,
+			.dualMode = dualMode,
+			.maxSubSteps = maxSubSteps,
+			.maxExtraPasses = maxExtraPasses,
+			.game = {} // filled in by the recorder
+		});
+	}
+
+	if (!firstFrame) skipUpdate = false;
+	else {
+		skipUpdate = true;
+		firstFrame = false;
+		if (cutoffMode == CutoffMode::LoopStart) {
+			for (auto& timeline : timelines) timeline.cursor.skipBatch();
+		}
+		return;
+	}
+
+#ifdef CBF_VALIDATE_TIMING
+	{
+		static std::vector<Input> frameInputs;
+
+		frameInputs.clear();
+		inputQueue.forEachInBatch([](const Input& input) { frameInputs.push_back(input); });
+		timingValidator.compareFrame(lastFrameTime, currentFrameTime - lastFrameTime, stepCount, frameInputs);
+	}
+#endif
+
+	CBF_TRACE_SCOPE(Plan, stepCount);
+	const Duration deltaTime = currentFrameTime - lastFrameTime;
+
+	for (int i = 0; i < activeTimelines; i++) {
+		auto& timeline = timelines[i];
+
+		timeline.coalescer.setMergeWindow(mergeWindowFor(deltaTime / stepCount));
+
+		// steps are generated lazily by nextStep
+		timeline.stepGenerator.reset(lastFrameTime, deltaTime, stepCount, maxSubSteps, maxExtraPasses);
+	}
+}
+
+}
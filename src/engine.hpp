@@ -0,0 +1,1107 @@
+#pragma once
+
+// the timing engine: input handoff, coalescing and step generation
+
+#include <stdint.h>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#ifdef CBF_HEADLESS
+// same values as the game's enum, which comes from Geode otherwise
+enum class PlayerButton {
+    Jump = 1,
+    Left = 2,
+    Right = 3
+};
+#else
+#include <Geode/Enums.hpp>
+#endif
+
+namespace cbf {
+
+// every timestamp in CBF is nanoseconds on the platform's monotonic frame clock, see getCurrentTime()
+// platforms convert their native clocks into it when inputs are captured
+struct FrameClock {
+    using rep = int64_t;
+    using period = std::nano;
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<FrameClock>;
+    static constexpr bool is_steady = true;
+};
+
+using TimestampType = FrameClock::time_point;
+using Duration = FrameClock::duration;
+
+// implemented once per platform (windows.cpp, android.cpp, macos.mm, linux.cpp)
+TimestampType getCurrentTime();
+
+// converts a reading of a clock that runs at frequency ticks per second, eg. QueryPerformanceCounter
+// whole seconds are split off first so ticks * 1e9 cant overflow, however long the machine has been up
+constexpr TimestampType timestampFromTicks(int64_t ticks, int64_t frequency) {
+    return TimestampType(Duration((ticks / frequency) * 1'000'000'000 + (ticks % frequency) * 1'000'000'000 / frequency));
+}
+
+enum class Player : bool {
+    Player1 = 0,
+    Player2 = 1,
+};
+
+enum InputState : bool {
+    Press = 0,
+    Release = 1
+};
+
+struct Input {
+    TimestampType time {};
+    PlayerButton type = PlayerButton::Jump;
+    InputState state = InputState::Press;
+    Player player = Player::Player1;
+};
+
+constexpr size_t cacheLineSize = 64;
+
+// single producer, single consumer ring buffer for the input thread -> game thread handoff
+// never allocates and never blocks: pushing into a full ring drops the item and bumps overflowCount
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of two");
+
+public:
+    // producer side
+    bool push(const T& item) {
+        const size_t write = writeIndex.load(std::memory_order_relaxed);
+        if (write - cachedReadIndex == Capacity) {
+            cachedReadIndex = readIndex.load(std::memory_order_acquire);
+            if (write - cachedReadIndex == Capacity) {
+                overflowCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        slots[write & (Capacity - 1)] = item;
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. takes every item with time <= cutoff as the current batch, stopping at the
+    // first later item so ordering is preserved. the batch is read in place through BatchCursor:
+    // taking it only moves indices, nothing is copied or freed, and its slots stay reserved until
+    // release() hands them back to the producer. unreleased items are part of the next batch again
+    size_t takeBatch(TimestampType cutoff) {
+        const size_t write = writeIndex.load(std::memory_order_acquire);
+        batchEndIndex = releasedIndex;
+        while (batchEndIndex != write && slot(batchEndIndex).time <= cutoff) batchEndIndex++;
+
+        return batchEndIndex - releasedIndex;
+    }
+
+    size_t batchBegin() const { return releasedIndex; }
+    size_t batchEnd() const { return batchEndIndex; }
+    const T& slot(size_t index) const { return slots[index & (Capacity - 1)]; }
+
+    // consumer side, gives every slot before index back to the producer
+    void release(size_t index) {
+        if (index <= releasedIndex || index > batchEndIndex) return;
+        releasedIndex = index;
+        readIndex.store(releasedIndex, std::memory_order_release);
+    }
+
+    template <typename F>
+    void forEachInBatch(F&& fn) const {
+        for (size_t i = releasedIndex; i != batchEndIndex; i++) fn(slot(i));
+    }
+
+    // consumer side, throws away everything currently queued
+    void clear() {
+        releasedIndex = batchEndIndex = writeIndex.load(std::memory_order_acquire);
+        readIndex.store(releasedIndex, std::memory_order_release);
+    }
+
+    size_t size() const {
+        return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
+    }
+
+    uint64_t overflows() const {
+        return overflowCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    // producer and consumer indices live on separate cache lines so they dont false share
+    alignas(cacheLineSize) std::atomic<size_t> readIndex = 0;
+    size_t releasedIndex = 0; // consumer's copy of readIndex
+    size_t batchEndIndex = 0;
+    alignas(cacheLineSize) std::atomic<size_t> writeIndex = 0;
+    size_t cachedReadIndex = 0; // producer's last view of readIndex
+    alignas(cacheLineSize) std::atomic<uint64_t> overflowCount = 0;
+    alignas(cacheLineSize) std::array<T, Capacity> slots;
+};
+
+// several input threads, each pushing into its own SpscRing lane so they never share anything,
+// merged into timestamp order on the consumer side. the consumer interface is the same as
+// SpscRing's, so BatchCursor reads a merged batch the same way
+//
+// takeBatch k-way merges everything the lanes hold into a pending ring owned by the consumer.
+// an input older than ones already pending is moved back into place, but by at most
+// maxReorderDepth slots and never past a pinned one: anything later than that is retimed to the input before it, so pending
+// always stays sorted and the cutoff scan can stop at the first later input
+template <size_t Lanes, size_t Capacity>
+class InputMerger {
+    static_assert(Lanes >= 1 && Lanes <= 32, "lanes are tracked in a 32 bit mask");
+    static_assert((Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of two");
+
+public:
+    static constexpr size_t maxReorderDepth = 32;
+
+    // producer side, only ever from the lane's own thread
+    bool push(size_t lane, const Input& input) {
+        return lanes[lane].push(input);
+    }
+
+    // lane 0 belongs to the platform's input hook, sources with a thread of their own claim one of the others
+    std::optional<size_t> claimLane() {
+        constexpr uint32_t claimable = static_cast<uint32_t>((uint64_t(1) << Lanes) - 1) & ~1u;
+
+        uint32_t used = usedLanes.load(std::memory_order_relaxed);
+        while (const uint32_t free = claimable & ~used) {
+            const uint32_t lane = std::countr_zero(free);
+            if (usedLanes.compare_exchange_weak(used, used | (1u << lane), std::memory_order_acq_rel)) return lane;
+        }
+        return std::nullopt;
+    }
+
+    // the lane's producer thread must have stopped pushing
+    void releaseLane(size_t lane) {
+        usedLanes.fetch_and(~(1u << lane), std::memory_order_release);
+    }
+
+    // consumer side, see SpscRing::takeBatch
+    size_t takeBatch(TimestampType cutoff) {
+        mergeLanes();
+
+        batchEndIndex = releasedIndex;
+        while (batchEndIndex != endIndex && slot(batchEndIndex).time <= cutoff) batchEndIndex++;
+
+        lastCutoff = cutoff;
+        return batchEndIndex - releasedIndex;
+    }
+
+    size_t batchBegin() const { return releasedIndex; }
+    size_t batchEnd() const { return batchEndIndex; }
+    const Input& slot(size_t index) const { return pending[index & (Capacity - 1)]; }
+
+    void release(size_t index) {
+        if (index <= releasedIndex || index > batchEndIndex) return;
+        releasedIndex = index;
+    }
+
+    // slots before index were already applied by some consumer but not released yet, merging never
+    // moves them. an input older than them is too late and is retimed to go right after them
+    void pin(size_t index) {
+        pinnedIndex = std::max(pinnedIndex, std::min(index, endIndex));
+    }
+
+    template <typename F>
+    void forEachInBatch(F&& fn) const {
+        for (size_t i = releasedIndex; i != batchEndIndex; i++) fn(slot(i));
+    }
+
+    void clear() {
+        for (auto& lane : lanes) lane.clear();
+        releasedIndex = batchEndIndex = endIndex;
+    }
+
+    uint64_t overflows() const {
+        uint64_t count = 0;
+        for (const auto& lane : lanes) count += lane.overflows();
+        return count;
+    }
+
+    // consumer side, everything queued whether it was merged yet or not
+    size_t size() const {
+        size_t count = endIndex - releasedIndex;
+        for (const auto& lane : lanes) count += lane.size();
+        return count;
+    }
+
+    // consumer side
+    uint64_t reordered() const { return reorderedCount; }
+    uint64_t late() const { return lateCount; }
+    size_t maxDepth() const { return maxDepthSeen; }
+    // inputs that were queued after a batch with a later cutoff was taken, so they missed their frame
+    uint64_t afterCutoff() const { return afterCutoffCount; }
+
+private:
+    void mergeLanes() {
+        std::array<size_t, Lanes> heads;
+        std::array<TimestampType, Lanes> headTimes;
+        uint32_t active = 0; // lanes with inputs left to merge
+        for (size_t i = 0; i < Lanes; i++) {
+            if (lanes[i].takeBatch(TimestampType::max())) {
+                active |= 1u << i;
+                headTimes[i] = lanes[i].slot(lanes[i].batchBegin()).time;
+            }
+            heads[i] = lanes[i].batchBegin();
+        }
+        if (!active) return;
+
+        // if pending is full the rest stays in the lanes, and they overflow once they fill up too
+        while ((active & (active - 1)) && endIndex - releasedIndex < Capacity) {
+            size_t oldest = std::countr_zero(active);
+            for (uint32_t rest = active & (active - 1); rest; rest &= rest - 1) {
+                const size_t i = std::countr_zero(rest);
+                if (headTimes[i] < headTimes[oldest]) oldest = i;
+            }
+
+            auto& ring = lanes[oldest];
+            insert(ring.slot(heads[oldest]++));
+            if (heads[oldest] == ring.batchEnd()) active &= ~(1u << oldest);
+            else headTimes[oldest] = ring.slot(heads[oldest]).time;
+        }
+
+        // one lane left, nothing to interleave it with
+        if (active && !(active & (active - 1))) {
+            const size_t lane = std::countr_zero(active);
+            auto& ring = lanes[lane];
+            while (heads[lane] != ring.batchEnd() && endIndex - releasedIndex < Capacity) insert(ring.slot(heads[lane]++));
+        }
+
+        for (size_t i = 0; i < Lanes; i++) lanes[i].release(heads[i]);
+    }
+
+    // input is copied straight from the lane into place, and in order inputs are appended without
+    // reading the previous slot back (its 14 byte copy is two overlapping stores that cant be forwarded)
+    void insert(const Input& input) {
+        if (input.time <= lastCutoff) afterCutoffCount++;
+
+        if (endIndex == releasedIndex || input.time >= newestTime) {
+            pending[endIndex++ & (Capacity - 1)] = input;
+            newestTime = input.time;
+            return;
+        }
+
+        const size_t floor = std::max(releasedIndex, pinnedIndex);
+        size_t index = endIndex++;
+        size_t depth = 0;
+        while (index != floor && depth != maxReorderDepth && slot(index - 1).time > input.time) {
+            pending[index & (Capacity - 1)] = slot(index - 1);
+            index--;
+            depth++;
+        }
+
+        Input& placed = pending[index & (Capacity - 1)];
+        placed = input;
+        if (index != releasedIndex && slot(index - 1).time > input.time) {
+            placed.time = slot(index - 1).time;
+            lateCount++;
+        }
+
+        if (depth) {
+            reorderedCount++;
+            maxDepthSeen = std::max(maxDepthSeen, depth);
+        }
+    }
+
+    std::array<SpscRing<Input, Capacity>, Lanes> lanes;
+    alignas(cacheLineSize) std::atomic<uint32_t> usedLanes = 0;
+
+    // consumer only from here on
+    alignas(cacheLineSize) size_t releasedIndex = 0;
+    size_t batchEndIndex = 0;
+    size_t endIndex = 0;
+    size_t pinnedIndex = 0;
+    uint64_t reorderedCount = 0; // inputs that were moved back to their place in time
+    uint64_t lateCount = 0; // inputs that were too far out of order or older than pinned ones, and got retimed
+    size_t maxDepthSeen = 0; // furthest an input was moved back
+    TimestampType newestTime {}; // of the last pending input
+    TimestampType lastCutoff = TimestampType::min();
+    uint64_t afterCutoffCount = 0;
+    std::array<Input, Capacity> pending;
+};
+
+// one timeline's view of the ring's current batch. with a player filter set, the other
+// player's inputs are skipped, so two cursors can walk the same batch independently.
+// the batch starts at the oldest input either timeline still needs, so inputs before a player's
+// entry in applied were already applied by some timeline and are skipped too
+template <typename Ring>
+class BatchCursor {
+public:
+    // index of the first input not yet applied, per player
+    using Applied = std::array<size_t, 2>;
+
+    explicit BatchCursor(Ring& ring) : ring(ring) {}
+
+    void reset(std::optional<Player> filter, const Applied& applied) {
+        index = ring.batchBegin();
+        player = filter;
+        this->applied = applied;
+    }
+
+    bool batchEmpty() {
+        while (index != ring.batchEnd() && !matches(index)) index++;
+        return index == ring.batchEnd();
+    }
+
+    // only valid after batchEmpty() returned false
+    const Input& batchFront() const { return ring.slot(index); }
+    void batchPop() { index++; }
+
+    // the input after batchFront() on this timeline, if any
+    const Input* batchNext() const {
+        for (size_t i = index + 1; i != ring.batchEnd(); i++) {
+            if (matches(i)) return &ring.slot(i);
+        }
+        return nullptr;
+    }
+
+    void skipBatch() { index = ring.batchEnd(); }
+
+    // everything before this on this timeline has been consumed
+    size_t position() const { return index; }
+
+    // raises applied to what this timeline consumed, for the players it walks
+    void markApplied(Applied& done) const {
+        for (size_t i = 0; i < done.size(); i++) {
+            if (!player || static_cast<size_t>(*player) == i) done[i] = std::max(done[i], index);
+        }
+    }
+
+private:
+    bool matches(size_t i) const {
+        const Input& input = ring.slot(i);
+        return (!player || input.player == *player) && i >= applied[static_cast<size_t>(input.player)];
+    }
+
+    Ring& ring;
+    size_t index = 0;
+    std::optional<Player> player;
+    Applied applied {};
+};
+
+struct Step {
+    // input that caused this new physics step
+    Input input;
+    // release folded into input by InputCoalescer, applied right after it
+    Input merged;
+    double deltaFactor = 1.0;
+    bool endStep = true;
+    // where input lands: the step it is in, and how far into that step (0-1)
+    int stepIndex = 0;
+    double stepFraction = 0.0;
+};
+
+// where an applied input landed, passed to Engine::nextStep callbacks that take it.
+// this is what tick based replay and bot formats cant represent, see input_export.hpp
+struct InputPlacement {
+    uint64_t frame = 0; // Engine::frameNumber of the frame that placed it
+    int stepCount = 0; // physics steps in that frame
+    int stepIndex = 0;
+    int subStep = 0; // sub-steps of the same physics step before the one that ended at the input
+    double stepFraction = 0.0; // how far into the step, 1 for inputs carried to the step's end
+    double deltaFactor = 0.0; // of the sub-step that ended at the input
+};
+
+// the state each button was last left in by an applied input, per player. the timelines share one, so
+// a player's buttons carry over when dual mode splits the players onto timelines of their own or joins them
+class ButtonStates {
+public:
+    enum class State : uint8_t { Unknown, Held, Released };
+
+    State& operator[](const Input& input) {
+        return states[static_cast<size_t>(input.player) * 3 + static_cast<size_t>(input.type) - 1];
+    }
+
+    // unknown again, eg. after a pause or a death
+    void forget() { states.fill(State::Unknown); }
+
+private:
+    std::array<State, 6> states {}; // 2 players * jump/left/right
+};
+
+// sits between the input ring and StepGenerator and filters out inputs that cant change the outcome
+// but would each cost a full extra update/collision pass:
+// - repeated presses or releases of a button that is already in that state
+// - a release that follows its press within mergeWindow, which is folded into the press
+template <typename Cursor>
+class InputCoalescer {
+public:
+    InputCoalescer(Cursor& cursor, ButtonStates& buttons) : cursor(cursor), buttons(buttons) {}
+
+    void setMergeWindow(Duration window) { mergeWindow = window; }
+
+    bool batchEmpty() {
+        while (!cursor.batchEmpty() && isRedundant(cursor.batchFront())) {
+            cursor.batchPop();
+            droppedInputs++;
+        }
+        return cursor.batchEmpty();
+    }
+
+    const Input& batchFront() const { return cursor.batchFront(); }
+
+    // the release merged into batchFront(), if any
+    Input batchMerged() const {
+        const Input& front = cursor.batchFront();
+        if (front.state != InputState::Press) return {};
+
+        const Input* next = cursor.batchNext();
+        if (next
+            && next->state == InputState::Release
+            && next->player == front.player
+            && next->type == front.type
+            && next->time - front.time <= mergeWindow)
+        {
+            return *next;
+        }
+        return {};
+    }
+
+    void batchPop() {
+        const bool merged = batchMerged().time != TimestampType {};
+        const Input& front = cursor.batchFront();
+        buttons[front] = front.state == InputState::Press && !merged ? ButtonStates::State::Held : ButtonStates::State::Released;
+
+        cursor.batchPop();
+        if (merged) {
+            cursor.batchEmpty(); // skips ahead to the merged release
+            cursor.batchPop();
+            mergedInputs++;
+        }
+    }
+
+    uint64_t droppedInputs = 0; // duplicate presses/releases
+    uint64_t mergedInputs = 0; // releases folded into their press
+
+private:
+    bool isRedundant(const Input& input) {
+        const ButtonStates::State state = buttons[input];
+        if (state == ButtonStates::State::Unknown) return false;
+        return (state == ButtonStates::State::Held) == (input.state == InputState::Press);
+    }
+
+    Cursor& cursor;
+    ButtonStates& buttons;
+    Duration mergeWindow {};
+};
+
+constexpr double smallestFloat = std::numeric_limits<float>::min(); // ensures deltaFactor can never be 0, even after being converted to float
+
+// InputCoalescer's window for a step this long: a release closer to its press than this would get a sub-step
+// below smallestFloat, which is clamped up to the same sub-step as a release at the press time. in whole
+// nanoseconds that is only a release at the exact same time, so no real hold is ever shortened
+constexpr Duration mergeWindowFor(Duration stepLength) {
+    return Duration(static_cast<int64_t>(static_cast<double>(stepLength.count()) * smallestFloat));
+}
+
+// yields a frame's physics steps one at a time as PlayerObject::update asks for them
+// a step is only split when the next pending input falls inside it, so nothing is planned
+// up front and a frame without inputs costs a couple of compares per step
+//
+// when a frame has more steps than maxSubSteps (lag spikes, physics bypass at low fps, slow timewarp)
+// only the last maxSubSteps steps are split. inputs landing before that are carried by the end step they
+// fall in and applied on its boundary, one per step, so they cost no extra update/collision pass
+//
+// at most maxSubStepInputs inputs per frame get their own sub-step, later ones are carried the same way
+//
+// step boundaries are exact integers: step i starts at frameStart + floor(deltaTime * i / stepCount),
+// walked with an error accumulator so the only divisions happen once per frame in reset(). steps are
+// either stepBase or stepBase + 1ns long, and both reciprocals are precomputed
+class StepGenerator {
+public:
+    void reset(TimestampType frameStart, Duration deltaTime, int stepCount, int maxSubSteps, int maxSubStepInputs) {
+        deltaTime = std::max(deltaTime, Duration::zero());
+        subStepInputsLeft = maxSubStepInputs;
+
+        this->stepCount = stepCount;
+        subStepStart = std::max(0, stepCount - std::max(1, maxSubSteps));
+        if (subStepStart > 0) catchUpFrames++;
+
+        stepBase = deltaTime / stepCount;
+        stepRemainder = (deltaTime % stepCount).count();
+        invShortStep = stepBase.count() ? 1.0 / stepBase.count() : 0.0;
+        invLongStep = 1.0 / (stepBase.count() + 1);
+
+        stepIndex = 0;
+        remainderAcc = 0;
+        stepEnd = frameStart;
+        carryEnd = {};
+        beginStep();
+    }
+
+    void clear() {
+        stepCount = 0;
+        stepIndex = 0;
+        carryEnd = {};
+    }
+
+    bool done() const { return stepIndex >= stepCount; }
+    int remainingSteps() const { return stepCount - stepIndex; }
+    int currentStep() const { return stepIndex; }
+    int stepTotal() const { return stepCount; }
+
+    // Source is the input ring, inputs are popped from its current batch as they get placed
+    template <typename Source>
+    Step next(Source& inputs) {
+        if (!inputs.batchEmpty()) {
+            const Input& front = inputs.batchFront();
+            // the last step also takes inputs sitting exactly on the frame end
+            if (front.time < stepEnd || stepIndex + 1 >= stepCount) {
+                if (stepIndex < subStepStart || subStepInputsLeft <= 0) {
+                    // the cap can run out partway through a step that was already split, only the rest of it is left
+                    Step step { front, mergedWith(inputs), std::max(smallestFloat, 1.0 - lastDFactor), true, stepIndex, 1.0 };
+                    inputs.batchPop();
+                    carryCatchUp = stepIndex < subStepStart;
+                    if (carryCatchUp) catchUpInputs++;
+                    else cappedInputs++;
+
+                    // the step's other inputs go on the same boundary, see takeCarried
+                    carryEnd = stepIndex + 1 >= stepCount ? TimestampType::max() : stepEnd;
+                    stepIndex++;
+                    beginStep();
+                    return step;
+                }
+
+                double dFactor = std::clamp(static_cast<double>((front.time - stepStart).count()) * invStep, 0.0, 1.0);
+                Step step { front, mergedWith(inputs), std::clamp(dFactor - lastDFactor, smallestFloat, 1.0), false, stepIndex, dFactor };
+                lastDFactor = dFactor;
+                subStepInputsLeft--;
+                inputs.batchPop();
+                return step;
+            }
+        }
+
+        Step step { {}, {}, std::max(smallestFloat, 1.0 - lastDFactor), true, stepIndex, 1.0 };
+        stepIndex++;
+        beginStep();
+        return step;
+    }
+
+    // the inputs after the one a step carried to its boundary that fell inside the same step, one per call.
+    // they are applied on that boundary too, instead of each waiting for a step of their own and backing up
+    // the queue when a frame has more of them than steps. only valid before the next step is generated,
+    // a frame's last step leaves them queued for the next frame
+    template <typename Source>
+    bool takeCarried(Source& inputs, Input& input, Input& merged) {
+        if (carryEnd == TimestampType {}) return false;
+        if (inputs.batchEmpty() || inputs.batchFront().time >= carryEnd) {
+            carryEnd = {};
+            return false;
+        }
+
+        input = inputs.batchFront();
+        merged = mergedWith(inputs);
+        inputs.batchPop();
+        if (carryCatchUp) catchUpInputs++;
+        else cappedInputs++;
+        return true;
+    }
+
+private:
+    template <typename Source>
+    static Input mergedWith(const Source& inputs) {
+        if constexpr (requires { inputs.batchMerged(); }) return inputs.batchMerged();
+        else return {};
+    }
+
+    void beginStep() {
+        stepStart = stepEnd;
+        lastDFactor = 0.0;
+
+        remainderAcc += stepRemainder;
+        if (remainderAcc >= stepCount) {
+            remainderAcc -= stepCount;
+            stepEnd = stepStart + stepBase + Duration(1);
+            invStep = invLongStep;
+        }
+        else {
+            stepEnd = stepStart + stepBase;
+            invStep = invShortStep;
+        }
+    }
+
+    Duration stepBase {};
+    int64_t stepRemainder = 0;
+    int64_t remainderAcc = 0;
+    TimestampType stepStart {};
+    TimestampType stepEnd {};
+    double invShortStep = 0.0;
+    double invLongStep = 0.0;
+    double invStep = 0.0;
+    int stepCount = 0;
+    int stepIndex = 0;
+    int subStepStart = 0;
+    int subStepInputsLeft = 0;
+    double lastDFactor = 0.0;
+    TimestampType carryEnd {}; // end of the step that last carried an input, empty once its inputs are taken
+    bool carryCatchUp = false;
+
+public:
+    uint64_t catchUpFrames = 0; // frames where the sub-step cap kicked in
+    uint64_t catchUpInputs = 0; // inputs applied on a step boundary because of it
+    uint64_t cappedInputs = 0; // inputs applied on a step boundary because of maxSubStepInputs
+};
+
+// compares StepGenerator against the double based split it replaced, which used
+// stepDelta = (deltaTime / stepCount) + 1 and a modulo + divide per input
+struct TimingValidator {
+    double maxDifference = 0.0; // largest difference in where an input landed, in steps (so in deltaFactor units)
+    uint64_t inputsCompared = 0;
+
+    template <typename Inputs>
+    double compareFrame(TimestampType frameStart, Duration deltaTime, int stepCount, const Inputs& inputs) {
+        struct Source {
+            const Inputs& inputs;
+            size_t index = 0;
+            bool batchEmpty() const { return index == inputs.size(); }
+            const Input& batchFront() const { return inputs[index]; }
+            void batchPop() { index++; }
+        } source { inputs };
+
+        const int64_t legacyStepDelta = (std::max<int64_t>(deltaTime.count(), 0) / stepCount) + 1;
+
+        StepGenerator generator;
+        generator.reset(frameStart, deltaTime, stepCount, stepCount, std::numeric_limits<int>::max());
+
+        double frameMax = 0.0;
+        double position = 0.0;
+        while (!generator.done()) {
+            const int stepIndex = generator.currentStep();
+            Step step = generator.next(source);
+            if (step.endStep) {
+                position = 0.0;
+                continue;
+            }
+
+            position += step.deltaFactor;
+            const int64_t offset = (step.input.time - frameStart).count();
+            const double legacy = offset > 0 ? static_cast<double>(offset) / legacyStepDelta : 0.0;
+
+            frameMax = std::max(frameMax, std::abs((stepIndex + position) - legacy));
+            inputsCompared++;
+        }
+
+        maxDifference = std::max(maxDifference, frameMax);
+        return frameMax;
+    }
+};
+
+// input sources that stamp events with their own clock, each gets its own ClockAligner
+enum class ClockSource : uint8_t {
+    Touch, // android MotionEvent times relayed through JNI
+    Mouse, // NSEvent timestamps on macos
+    Evdev, // kernel input_event times on linux
+    Count
+};
+
+constexpr const char* clockSourceNames[] = { "touch", "mouse", "evdev" };
+static_assert(std::size(clockSourceNames) == static_cast<size_t>(ClockSource::Count));
+
+// maps event timestamps from an input source's clock onto the frame clock, falling back to the
+// time the event was received when there is no usable timestamp
+//
+// receiveTime - eventTime is the clock offset plus the delivery delay, and the delay is never
+// negative, so the smallest one seen is the best guess for the offset. the minimum is kept per
+// window and the last two windows are used so it follows drift instead of sticking forever.
+// a small positive minimum is just delivery delay on the same clock and is not applied, anything
+// else means the source really is on another clock (or an offset one) and gets corrected
+//
+// align() must only be called from the thread that produces the source's inputs, the counters can be read anywhere
+class ClockAligner {
+public:
+    static constexpr Duration window = std::chrono::seconds(2);
+    static constexpr Duration maxDelay = std::chrono::milliseconds(100); // older than this after alignment = implausible
+    static constexpr int resyncAfter = 4; // implausible events in a row before the estimate is thrown away
+
+    TimestampType align(TimestampType eventTime, TimestampType receiveTime) {
+        if (eventTime == TimestampType {}) {
+            missingCount.fetch_add(1, std::memory_order_relaxed);
+            return receiveTime;
+        }
+
+        const Duration offset = receiveTime - eventTime;
+        TimestampType aligned = eventTime + clockOffset(receiveTime);
+
+        if (aligned < receiveTime - maxDelay || aligned > receiveTime + maxDelay) {
+            if (++implausibleRun < resyncAfter) {
+                rejectedCount.fetch_add(1, std::memory_order_relaxed);
+                return receiveTime;
+            }
+
+            // the source's clock jumped (or was never seen), start over from this event
+            resyncCount.fetch_add(1, std::memory_order_relaxed);
+            resync(offset, receiveTime);
+            aligned = eventTime + clockOffset(receiveTime);
+        }
+        implausibleRun = 0;
+        track(offset, receiveTime);
+
+        // cant have happened after it was received
+        if (aligned > receiveTime) {
+            correctedCount.fetch_add(1, std::memory_order_relaxed);
+            aligned = receiveTime;
+        }
+
+        alignedCount.fetch_add(1, std::memory_order_relaxed);
+        return aligned;
+    }
+
+    uint64_t aligned() const { return alignedCount.load(std::memory_order_relaxed); }
+    uint64_t missing() const { return missingCount.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return rejectedCount.load(std::memory_order_relaxed); }
+    uint64_t corrected() const { return correctedCount.load(std::memory_order_relaxed); }
+    uint64_t resyncs() const { return resyncCount.load(std::memory_order_relaxed); }
+    Duration offset() const { return Duration(offsetNs.load(std::memory_order_relaxed)); }
+    double drift() const { return driftPpm.load(std::memory_order_relaxed); } // how fast the offset moves, in ppm of frame clock time
+
+private:
+    static constexpr Duration noSample = Duration::max();
+
+    // offset applied to event times, 0 while the source looks like it shares the frame clock
+    Duration clockOffset(TimestampType receiveTime) const {
+        Duration estimate = currentMin;
+        if (previousMin != noSample) {
+            // the previous window's minimum, moved forward by the drift seen between windows
+            const auto elapsed = static_cast<double>((receiveTime - windowStart).count());
+            estimate = std::min(estimate, previousMin + Duration(static_cast<int64_t>(elapsed * drift() * 1e-6)));
+        }
+
+        if (estimate == noSample || (estimate >= Duration(0) && estimate <= maxDelay)) return Duration(0);
+        return estimate;
+    }
+
+    void track(Duration offset, TimestampType receiveTime) {
+        if (receiveTime - windowStart >= window) {
+            if (previousMin != noSample && currentMin != noSample) {
+                const auto elapsed = static_cast<double>((receiveTime - windowStart).count());
+                driftPpm.store(static_cast<double>((currentMin - previousMin).count()) / elapsed * 1e6, std::memory_order_relaxed);
+            }
+            previousMin = currentMin;
+            currentMin = noSample;
+            windowStart = receiveTime;
+        }
+
+        currentMin = std::min(currentMin, offset);
+        offsetNs.store(clockOffset(receiveTime).count(), std::memory_order_relaxed);
+    }
+
+    void resync(Duration offset, TimestampType receiveTime) {
+        previousMin = noSample;
+        currentMin = offset;
+        windowStart = receiveTime;
+        driftPpm.store(0.0, std::memory_order_relaxed);
+    }
+
+    Duration currentMin = noSample;
+    Duration previousMin = noSample;
+    TimestampType windowStart {};
+    int implausibleRun = 0;
+
+    std::atomic<uint64_t> alignedCount = 0;
+    std::atomic<uint64_t> missingCount = 0; // no timestamp, receive time used
+    std::atomic<uint64_t> rejectedCount = 0; // implausible timestamp, receive time used
+    std::atomic<uint64_t> correctedCount = 0; // timestamp after receive time, clamped
+    std::atomic<uint64_t> resyncCount = 0;
+    std::atomic<int64_t> offsetNs = 0;
+    std::atomic<double> driftPpm = 0.0;
+};
+
+enum class TouchAction : uint8_t {
+    Any, // the launcher didnt say, matches either
+    Down,
+    Up
+};
+
+struct TouchTimestamp {
+    TimestampType time {};
+    int32_t pointerId = -1; // -1 = unknown, matches any touch
+    TouchAction action = TouchAction::Any;
+};
+
+// timestamps the android launcher reports for each MotionEvent, waiting to be matched to the
+// CCTouches cocos dispatches for them a bit later on the gl thread
+// record() is called from the ui thread, take() from the gl thread
+class TouchTimestampQueue {
+public:
+    static constexpr size_t maxPending = 16;
+
+    bool record(const TouchTimestamp& touch) {
+        return ring.push(touch);
+    }
+
+    // timestamp of the oldest report matching this touch, or an empty one if there is none
+    // reports older than maxAge are dropped, their touch was already dispatched without them.
+    // an Any report is replaced by the next one for the same pointer: older launchers report every
+    // MotionEvent, and the ones that never become a touch (moves, ignored pointers) would pile up
+    // and hand a later touch a stale time
+    TimestampType take(int32_t pointerId, TouchAction action, TimestampType now, Duration maxAge = ClockAligner::maxDelay) {
+        ring.takeBatch(TimestampType::max());
+        ring.forEachInBatch([&](const TouchTimestamp& touch) {
+            if (touch.action == TouchAction::Any) {
+                for (size_t i = pendingCount; i-- > 0;) {
+                    if (pending[i].action == TouchAction::Any && pending[i].pointerId == touch.pointerId) {
+                        dropPending(i);
+                        staleCount++;
+                    }
+                }
+            }
+            if (pendingCount == maxPending) {
+                dropPending(0);
+                staleCount++;
+            }
+            pending[pendingCount++] = touch;
+        });
+        ring.release(ring.batchEnd());
+
+        const auto end = std::remove_if(pending.begin(), pending.begin() + pendingCount, [&](const TouchTimestamp& touch) {
+            return touch.time < now - maxAge;
+        });
+        staleCount += pending.begin() + pendingCount - end;
+        pendingCount = end - pending.begin();
+
+        for (size_t i = 0; i < pendingCount; i++) {
+            const TouchTimestamp& touch = pending[i];
+            if ((touch.pointerId == -1 || touch.pointerId == pointerId) && (touch.action == TouchAction::Any || touch.action == action)) {
+                const TimestampType time = touch.time;
+                dropPending(i);
+                return time;
+            }
+        }
+
+        unmatchedCount++;
+        return {};
+    }
+
+    uint64_t stale() const { return staleCount; } // reports nothing was dispatched for
+    uint64_t unmatched() const { return unmatchedCount; } // touches without a report
+    uint64_t overflows() const { return ring.overflows(); }
+
+private:
+    void dropPending(size_t index) {
+        std::copy(pending.begin() + index + 1, pending.begin() + pendingCount, pending.begin() + index);
+        pendingCount--;
+    }
+
+    SpscRing<TouchTimestamp, 64> ring;
+    std::array<TouchTimestamp, maxPending> pending {}; // oldest first
+    size_t pendingCount = 0;
+    uint64_t staleCount = 0;
+    uint64_t unmatchedCount = 0;
+};
+
+// enough for a few frames of 8khz input even at very low fps
+constexpr size_t inputQueueCapacity = 1024;
+// the platform hook plus a few InputSources
+constexpr size_t inputLanes = 4;
+
+using InputQueue = InputMerger<inputLanes, inputQueueCapacity>;
+
+enum class CutoffMode : uint8_t {
+    LoopStart, // inputs up to the start of the game loop (clearQueuesBeforeLoop)
+    Physics, // inputs up to the physics update (late cutoff)
+    Adaptive, // as close to the physics update as CutoffPredictor thinks is safe
+    Count
+};
+
+constexpr const char* cutoffModeNames[] = { "loop", "late", "adaptive" };
+static_assert(std::size(cutoffModeNames) == static_cast<size_t>(CutoffMode::Count));
+
+// places the adaptive cutoff at the loop start plus the shortest loop start -> physics update time of the
+// last historySize frames, minus a margin for inputs that are timestamped but not queued yet
+//
+// frame lengths then follow the loop start, which the game's delta is measured on, so steps line up as
+// well as with a loop start cutoff, only later. a loop start -> physics time shorter than the history's
+// is cut at now - margin for that frame. the margin doubles whenever inputs arrive after their frame was
+// cut off and decays back slowly, and erratic frame pacing pulls the shortest time, and so the cutoff,
+// back towards the loop start
+class CutoffPredictor {
+public:
+    static constexpr size_t historySize = 16;
+    static constexpr Duration minMargin = std::chrono::microseconds(100);
+    static constexpr Duration maxMargin = std::chrono::milliseconds(4);
+
+    void beginLoop(TimestampType now) { loopStart = now; }
+
+    TimestampType cutoff(TimestampType now) {
+        history[historyIndex++ % historySize] = std::max(now - loopStart, Duration::zero());
+
+        Duration shortest = Duration::max();
+        for (size_t i = 0; i < std::min(historyIndex, historySize); i++) shortest = std::min(shortest, history[i]);
+
+        const TimestampType cutoff = std::max(loopStart, loopStart + shortest - safetyMargin);
+        marginSum += now - cutoff;
+        frameCount++;
+
+        safetyMargin = std::max(minMargin, safetyMargin - safetyMargin / 64);
+        return cutoff;
+    }
+
+    // inputs that arrived after the previous cutoff
+    void deferred(uint64_t count) {
+        if (!count) return;
+        deferredCount += count;
+        safetyMargin = std::min(maxMargin, safetyMargin * 2);
+    }
+
+    uint64_t frames() const { return frameCount; }
+    uint64_t deferredInputs() const { return deferredCount; }
+    Duration margin() const { return safetyMargin; }
+    // how far before the physics update the cutoff was on average
+    Duration meanCutoffMargin() const { return frameCount ? marginSum / static_cast<int64_t>(frameCount) : Duration::zero(); }
+
+private:
+    std::array<Duration, historySize> history {};
+    size_t historyIndex = 0;
+    TimestampType loopStart {};
+    Duration safetyMargin = std::chrono::microseconds(250);
+
+    uint64_t frameCount = 0;
+    uint64_t deferredCount = 0;
+    Duration marginSum {};
+};
+
+// the inputs and steps of one player in a two player level in dual mode, or of both players otherwise
+// each player is only sub-stepped at its own inputs, and both timelines end on the same frame time
+struct Timeline {
+    Timeline(InputQueue& queue, ButtonStates& buttons) : cursor(queue), coalescer(cursor, buttons) {}
+    Timeline(const Timeline&) = delete;
+    Timeline& operator=(const Timeline&) = delete;
+
+    BatchCursor<InputQueue> cursor;
+    InputCoalescer<BatchCursor<InputQueue>> coalescer;
+    StepGenerator stepGenerator;
+
+    Input nextInput;
+    Input nextMerged;
+    InputPlacement nextPlacement; // of nextInput and nextMerged
+
+    // p2's timeline carried these past the end of dual mode, they are applied with this one's first step
+    Input handedInput;
+    Input handedMerged;
+    InputPlacement handedPlacement;
+    int subStep = 0; // sub-steps of the current physics step so far
+};
+
+// everything CBF does between the game's hooks, driven by them through the functions in main.cpp
+class Recorder; // recording.hpp
+
+class Engine {
+public:
+    Engine() = default;
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    // must only be called from the lane's own thread, lane 0 is the platform's input hook
+    void addInput(const Input& input, size_t lane = 0) {
+        addInput(input, lane, input.time, input.time);
+    }
+
+    // same, for an input whose time was aligned from eventTime, the source's own timestamp of it.
+    // receiveTime is getCurrentTime() when the event arrived, both only go into recordings
+    void addInput(const Input& input, size_t lane, TimestampType eventTime, TimestampType receiveTime) {
+        inputQueue.push(lane, input);
+        if (Recorder* active = recorder.load(std::memory_order_acquire)) recordInput(*active, lane, input, eventTime, receiveTime);
+    }
+
+    // same, for the platform hook's inputs stamped by a source's own clock
+    void addInput(Input input, ClockSource source, TimestampType receiveTime) {
+        const TimestampType eventTime = input.time;
+        input.time = clockAligners[static_cast<size_t>(source)].align(input.time, receiveTime);
+        addInput(input, 0, eventTime, receiveTime);
+    }
+
+    // start of a game loop iteration (clearQueuesBeforeLoop)
+    void beginLoop(TimestampType now);
+
+    // drops every queued input and starts over, eg. while paused
+    void reset();
+
+    // no level is running or the player is dead, nothing gets sub-stepped until the next frame after this
+    void suspend();
+
+    // start of a physics frame (updateInputQueueAndTime), now is the cutoff in CutoffMode::Physics.
+    // dualMode splits the players onto a timeline each, only for two player levels where they have inputs of their own
+    void beginFrame(int stepCount, bool dualMode, TimestampType now);
+
+    // next step of a timeline (updateDeltaFactorAndInput). inputs placed by the previous step
+    // are passed to applyInput first, since they happen on the boundary between the two.
+    // an input carried by a frame's last step is applied on the first step of the next frame.
+    // applyInput can also take an InputPlacement as its second argument
+    template <typename F>
+    Step nextStep(Timeline& timeline, F&& onInput) {
+        if (timeline.stepGenerator.done()) return {};
+
+        auto applyInput = [&](const Input& input, const InputPlacement& placement) {
+            if constexpr (std::is_invocable_v<F&, const Input&, const InputPlacement&>) onInput(input, placement);
+            else onInput(input);
+        };
+
+        if (timeline.handedInput.time != TimestampType {}) {
+            applyInput(timeline.handedInput, timeline.handedPlacement);
+            if (timeline.handedMerged.time != TimestampType {}) applyInput(timeline.handedMerged, timeline.handedPlacement);
+            timeline.handedInput = {};
+            timeline.handedMerged = {};
+        }
+
+        if (timeline.nextInput.time != TimestampType {}) {
+            applyInput(timeline.nextInput, timeline.nextPlacement);
+            if (timeline.nextMerged.time != TimestampType {}) applyInput(timeline.nextMerged, timeline.nextPlacement);
+
+            Input carried, carriedMerged;
+            while (timeline.stepGenerator.takeCarried(timeline.coalescer, carried, carriedMerged)) {
+                applyInput(carried, timeline.nextPlacement);
+                if (carriedMerged.time != TimestampType {}) applyInput(carriedMerged, timeline.nextPlacement);
+            }
+        }
+
+        Step front = timeline.stepGenerator.next(timeline.coalescer);
+
+        timeline.nextInput = front.input;
+        timeline.nextMerged = front.merged;
+        timeline.nextPlacement = { frameNumber, timeline.stepGenerator.stepTotal(), front.stepIndex, timeline.subStep, front.stepFraction, front.deltaFactor };
+        timeline.subStep = front.endStep ? 0 : timeline.subStep + 1;
+
+        return front;
+    }
+
+    InputQueue inputQueue;
+    ClockAligner clockAligners[static_cast<size_t>(ClockSource::Count)];
+
+    ButtonStates buttonStates;
+    Timeline timelines[2] { Timeline(inputQueue, buttonStates), Timeline(inputQueue, buttonStates) };
+    int activeTimelines = 1;
+
+    uint64_t leftoverSteps = 0; // steps that were never reached by PlayerObject::update
+    BatchCursor<InputQueue>::Applied appliedInputs {}; // see BatchCursor
+    uint64_t frameNumber = 0; // beginFrame calls so far
+
+    TimestampType lastFrameTime {};
+    TimestampType lastPhysicsFrameTime {};
+    TimestampType currentFrameTime {};
+
+    bool firstFrame = true;
+    bool skipUpdate = true;
+    CutoffMode cutoffMode = CutoffMode::LoopStart;
+    CutoffPredictor cutoffPredictor;
+    int maxSubSteps = 48;
+    int maxExtraPasses = 32;
+
+    // everything the engine is fed also goes here while set, see recording.hpp
+    std::atomic<Recorder*> recorder = nullptr;
+
+#ifdef CBF_VALIDATE_TIMING
+    TimingValidator timingValidator;
+#endif
+
+private:
+    // out of line so the input path only pays for recording while there is a recorder
+    static void recordInput(Recorder& recorder, size_t lane, const Input& input, TimestampType eventTime, TimestampType receiveTime);
+};
+
+}
@@ -0,0 +1,234 @@
+#include "evdev.hpp"
+#include "trace.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdio>
+#include <future>
+
+namespace cbf {
+
+EvdevSource::EvdevSource(Engine& engine, std::string path, const KeybindTable& keys)
+	: InputSource(engine), path(std::move(path)), keys(keys) {}
+
+EvdevSource::~EvdevSource() {
+	stop();
+}
+
+const KeybindTable& EvdevSource::defaultKeys() {
+	static const KeybindTable table = [] {
+		KeybindTable table;
+		table.bind(KEY_SPACE, Player::Player1, PlayerButton::Jump);
+		table.bind(KEY_W, Player::Player1, PlayerButton::Jump);
+		table.bind(KEY_A, Player::Player1, PlayerButton::Left);
+		table.bind(KEY_D, Player::Player1, PlayerButton::Right);
+		table.bind(KEY_UP, Player::Player2, PlayerButton::Jump);
+		table.bind(KEY_LEFT, Player::Player2, PlayerButton::Left);
+		table.bind(KEY_RIGHT, Player::Player2, PlayerButton::Right);
+		table.rightClick = true;
+		return table;
+	}();
+	return table;
+}
+
+bool EvdevSource::start() {
+	if (thread.joinable()) return true;
+	if (!hasLane()) {
+		lastError = "too many input sources, no queue lane left for " + path;
+		return false;
+	}
+
+	fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		lastError = "cant open " + path + ": " + strerror(errno);
+		return false;
+	}
+
+	char deviceName[256] = {};
+	if (ioctl(fd, EVIOCGNAME(sizeof(deviceName) - 1), deviceName) >= 0) name = deviceName;
+
+	input_id id {};
+	if (ioctl(fd, EVIOCGID, &id) >= 0) {
+		bus = id.bustype;
+		vendor = id.vendor;
+		product = id.product;
+	}
+
+	// event times default to CLOCK_REALTIME, which jumps with ntp and isnt the frame clock
+	int clockId = CLOCK_MONOTONIC;
+	monotonic = ioctl(fd, EVIOCSCLOCKID, &clockId) == 0;
+
+	stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (stopFd < 0) {
+		lastError = std::string("eventfd failed: ") + strerror(errno);
+		close(fd);
+		fd = -1;
+		return false;
+	}
+
+	// the thread applies the policy to itself first, start() waits for that so threadPolicyError() is ready
+	std::promise<void> policyApplied;
+	auto ready = policyApplied.get_future();
+	thread = std::thread([this, &policyApplied] {
+		CBF_TRACE_THREAD("evdev");
+		applyInputThreadPolicy(threadPolicy, policyError);
+		policyApplied.set_value();
+		run();
+	});
+	ready.wait();
+	return true;
+}
+
+void EvdevSource::stop() {
+	if (thread.joinable()) {
+		const uint64_t one = 1;
+		if (write(stopFd, &one, sizeof(one)) != sizeof(one)) std::perror("evdev stop");
+		thread.join();
+	}
+
+	if (stopFd >= 0) close(stopFd);
+	if (fd >= 0) close(fd);
+	stopFd = fd = -1;
+}
+
+std::string EvdevSource::identity() const {
+	char ids[32];
+	std::snprintf(ids, sizeof(ids), "%04x:%04x:%04x", bus, vendor, product);
+	return (name.empty() ? path : name) + " (" + ids + ", " + path + ")";
+}
+
+namespace {
+
+// one bit per key code, the layout EVIOCGKEY fills in
+using KeyBits = std::array<uint8_t, KEY_MAX / 8 + 1>;
+
+bool testKey(const KeyBits& bits, unsigned code) {
+	return bits[code / 8] & (1u << (code % 8));
+}
+
+void setKey(KeyBits& bits, unsigned code, bool down) {
+	if (down) bits[code / 8] |= static_cast<uint8_t>(1u << (code % 8));
+	else bits[code / 8] &= static_cast<uint8_t>(~(1u << (code % 8)));
+}
+
+}
+
+void EvdevSource::run() {
+	std::array<input_event, 64> buffer;
+	pollfd fds[2] = { { fd, POLLIN, 0 }, { stopFd, POLLIN, 0 } };
+
+	// the keys held as far as the events read so far say, to resync against after the kernel dropped some
+	KeyBits held {};
+	ioctl(fd, EVIOCGKEY(sizeof(held)), held.data());
+	// after SYN_DROPPED everything up to the next SYN_REPORT is incomplete and thrown away
+	bool dropping = false;
+
+	// pushes a key transition if it is bound
+	auto pushKey = [&](unsigned code, bool down, TimestampType time, TimestampType receiveTime) {
+		Input input { .time = time, .state = down ? InputState::Press : InputState::Release };
+
+		if (code == BTN_LEFT) input.type = PlayerButton::Jump;
+		else if (code == BTN_RIGHT) {
+			if (!keys.rightClick) return false;
+			input.type = PlayerButton::Jump;
+			input.player = Player::Player2;
+		}
+		else {
+			const auto& bind = keys.find(code);
+			if (!bind.bound) return false;
+			input.type = bind.button;
+			input.player = bind.player;
+		}
+
+		push(input, receiveTime);
+		events.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	};
+
+	// whatever changed while events were lost, as if it happened now. now is on the device's clock like its events
+	auto resync = [&](TimestampType receiveTime) {
+		uint32_t pushed = 0;
+		KeyBits current {};
+		if (ioctl(fd, EVIOCGKEY(sizeof(current)), current.data()) < 0) return pushed;
+
+		timespec now {};
+		clock_gettime(monotonic ? CLOCK_MONOTONIC : CLOCK_REALTIME, &now);
+		const TimestampType time = TimestampType(std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec));
+
+		for (unsigned code = 0; code <= KEY_MAX; code++) {
+			const bool down = testKey(current, code);
+			if (down != testKey(held, code)) pushed += pushKey(code, down, time, receiveTime);
+		}
+		held = current;
+		return pushed;
+	};
+
+	// busy polling never sleeps in the kernel, so there is no scheduler wakeup between the event and reading it
+	const int timeout = threadPolicy.busyPoll ? 0 : -1;
+
+	while (true) {
+		const int ready = poll(fds, 2, timeout);
+		if (ready < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		if (ready == 0) continue;
+
+		const TimestampType wakeTime = getCurrentTime();
+		uint32_t queued = 0;
+		if (fds[1].revents) return;
+		if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) return; // unplugged
+		CBF_TRACE_BEGIN(Input);
+
+		// everything the kernel has queued, in as few reads as possible
+		while (true) {
+			const ssize_t bytes = read(fd, buffer.data(), sizeof(buffer));
+			if (bytes <= 0) {
+				if (bytes < 0 && errno == EINTR) continue;
+				if (bytes < 0 && errno == EAGAIN) break;
+				return; // ENODEV etc
+			}
+
+			const TimestampType receiveTime = getCurrentTime();
+			const size_t count = static_cast<size_t>(bytes) / sizeof(input_event);
+
+			for (size_t i = 0; i < count; i++) {
+				const input_event& event = buffer[i];
+				if (event.type == EV_SYN && event.code == SYN_DROPPED) {
+					droppedReports.fetch_add(1, std::memory_order_relaxed);
+					dropping = true;
+					continue;
+				}
+				if (dropping) {
+					if (event.type == EV_SYN && event.code == SYN_REPORT) {
+						dropping = false;
+						queued += resync(receiveTime);
+					}
+					continue;
+				}
+				if (event.type != EV_KEY || event.value == 2 || event.code > KEY_MAX) continue; // 2 is autorepeat
+
+				setKey(held, event.code, event.value);
+				const TimestampType time = TimestampType(std::chrono::seconds(event.input_event_sec) + std::chrono::microseconds(event.input_event_usec));
+				queued += pushKey(event.code, event.value, time, receiveTime);
+			}
+
+			if (static_cast<size_t>(bytes) < sizeof(buffer)) break;
+		}
+
+		// wakeups for motion and other unbound events arent counted
+		if (queued) wakeupLatency.record(getCurrentTime() - wakeTime);
+		CBF_TRACE_END(Input, queued);
+	}
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// linux input capture straight from /dev/input/event*, timestamped by the kernel when the
+// event came in. reading the device needs read access to it (usually the input group)
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "input_source.hpp"
+#include "keybinds.hpp"
+
+namespace cbf {
+
+class EvdevSource : public InputSource {
+public:
+    // keys are looked up by evdev key code (KEY_*), BTN_LEFT is p1 jump and BTN_RIGHT p2 jump if keys.rightClick
+    EvdevSource(Engine& engine, std::string path, const KeybindTable& keys = defaultKeys());
+    ~EvdevSource() override;
+
+    bool start() override;
+    void stop() override;
+
+    ClockSource clock() const override { return ClockSource::Evdev; }
+    std::string identity() const override;
+
+    // false if the kernel refused EVIOCSCLOCKID, timestamps are then CLOCK_REALTIME and ClockAligner corrects them
+    bool monotonicTimestamps() const { return monotonic; }
+
+    // GD's default binds: space/w/a/d for p1, up/left/right for p2
+    static const KeybindTable& defaultKeys();
+
+private:
+    void run();
+
+    std::string path;
+    KeybindTable keys;
+    std::string name;
+    uint16_t bus = 0, vendor = 0, product = 0;
+    bool monotonic = false;
+
+    int fd = -1;
+    int stopFd = -1;
+    std::thread thread;
+
+public:
+    std::atomic<uint64_t> events = 0; // button transitions pushed
+    std::atomic<uint64_t> droppedReports = 0; // SYN_DROPPED, the kernel's buffer overflowed. held keys are resynced after each
+};
+
+}
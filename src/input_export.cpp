@@ -0,0 +1,304 @@
+#include "input_export.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace cbf {
+
+using namespace input_export;
+
+namespace {
+
+// longest a record can encode to
+constexpr size_t maxRecordSize = 5 * 10 + 2 * 8 + 1;
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+void putDouble(std::vector<uint8_t>& out, double value) {
+	uint8_t bytes[sizeof(value)];
+	std::memcpy(bytes, &value, sizeof(value));
+	out.insert(out.end(), bytes, bytes + sizeof(bytes));
+}
+
+bool getVarint(std::span<const uint8_t> data, size_t& offset, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && offset < data.size(); shift += 7) {
+		const uint8_t next = data[offset++];
+		value |= static_cast<uint64_t>(next & 0x7f) << shift;
+		if (!(next & 0x80)) return true;
+	}
+	return false;
+}
+
+bool getDouble(std::span<const uint8_t> data, size_t& offset, double& value) {
+	if (data.size() - offset < sizeof(value)) return false;
+	std::memcpy(&value, data.data() + offset, sizeof(value));
+	offset += sizeof(value);
+	return true;
+}
+
+}
+
+bool InputExportWriter::start(const char* path, uint64_t firstFrame, std::string& error) {
+	if (running()) {
+		error = "already exporting";
+		return false;
+	}
+
+	file = std::fopen(path, "wb");
+	if (!file) {
+		error = std::string("cant create ") + path;
+		return false;
+	}
+
+	ExportHeader header {};
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	std::fwrite(&header, sizeof(header), 1, file);
+
+	lastFrame = firstFrame;
+	written = 0;
+	stopping = false;
+
+	// both buffers are allocated up front, they are only swapped after this
+	buffer.clear();
+	buffer.reserve(flushSize + maxRecordSize);
+	pending.clear();
+	pending.reserve(flushSize + maxRecordSize);
+
+	writer = std::thread([this] {
+		std::vector<uint8_t> out;
+		out.reserve(flushSize + maxRecordSize);
+
+		std::unique_lock lock(mutex);
+		while (true) {
+			wake.wait(lock, [&] { return stopping || !pending.empty(); });
+			if (pending.empty()) return;
+
+			// the empty buffer with its capacity goes back, so the next hand off doesnt allocate either
+			out.swap(pending);
+			lock.unlock();
+			std::fwrite(out.data(), 1, out.size(), file);
+			std::fflush(file);
+			out.clear();
+			lock.lock();
+		}
+	});
+	return true;
+}
+
+void InputExportWriter::stop() {
+	if (!running()) return;
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+
+	// whatever the writer didnt get to, in order
+	std::fwrite(pending.data(), 1, pending.size(), file);
+	std::fwrite(buffer.data(), 1, buffer.size(), file);
+	pending.clear();
+	buffer.clear();
+	std::fclose(file);
+	file = nullptr;
+}
+
+void InputExportWriter::write(const Engine& engine, const Input& input, const InputPlacement& placement) {
+	if (!running()) return;
+
+	const uint64_t frame = std::max(placement.frame, lastFrame);
+	putVarint(buffer, frame - lastFrame);
+	lastFrame = frame;
+
+	putVarint(buffer, static_cast<uint64_t>(std::max(placement.stepCount, 0)));
+	putVarint(buffer, static_cast<uint64_t>(std::max(placement.stepIndex, 0)));
+	putVarint(buffer, static_cast<uint64_t>(std::max(placement.subStep, 0)));
+	putVarint(buffer, static_cast<uint64_t>(std::max(engine.maxSubSteps, 0)));
+	putVarint(buffer, static_cast<uint64_t>(std::max(engine.maxExtraPasses, 0)));
+	putDouble(buffer, placement.stepFraction);
+	putDouble(buffer, placement.deltaFactor);
+	buffer.push_back(static_cast<uint8_t>(input.type) | static_cast<uint8_t>(input.state) << 2
+		| static_cast<uint8_t>(input.player) << 3 | (engine.activeTimelines == 2) << 4);
+	written++;
+
+	if (buffer.size() >= flushSize) handOff();
+}
+
+void InputExportWriter::handOff() {
+	// if the writer is still busy with the last buffer this one just keeps growing until the next input
+	std::unique_lock lock(mutex, std::try_to_lock);
+	if (!lock.owns_lock() || !pending.empty()) return;
+
+	buffer.swap(pending);
+	lock.unlock();
+	wake.notify_one();
+}
+
+InputExportReader::InputExportReader(std::span<const uint8_t> data) : data(data) {
+	ExportHeader header;
+	if (data.size() < sizeof(header)) {
+		lastError = "too short for an input export";
+		return;
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::memcmp(header.magic, magic, sizeof(magic))) lastError = "not an input export";
+	else if (header.version != version) lastError = "input export version " + std::to_string(header.version) + ", this reads " + std::to_string(version);
+	offset = sizeof(header);
+}
+
+bool InputExportReader::next(PlacedInput& placed) {
+	if (!valid() || cutOff || offset == data.size()) return false;
+
+	uint64_t frames, stepCount, stepIndex, subStep, maxSubSteps, maxExtraPasses;
+	double stepFraction, deltaFactor;
+	const bool ok = getVarint(data, offset, frames)
+		&& getVarint(data, offset, stepCount)
+		&& getVarint(data, offset, stepIndex)
+		&& getVarint(data, offset, subStep)
+		&& getVarint(data, offset, maxSubSteps)
+		&& getVarint(data, offset, maxExtraPasses)
+		&& getDouble(data, offset, stepFraction)
+		&& getDouble(data, offset, deltaFactor)
+		&& offset < data.size();
+	const uint8_t packed = ok ? data[offset++] : 0;
+	if (!ok || (packed & 3) == 0 || stepIndex >= stepCount) {
+		cutOff = true;
+		return false;
+	}
+
+	frame += frames;
+	placed = {};
+	placed.input.type = static_cast<PlayerButton>(packed & 3);
+	placed.input.state = static_cast<InputState>(packed >> 2 & 1);
+	placed.input.player = static_cast<Player>(packed >> 3 & 1);
+	placed.dualMode = packed >> 4 & 1;
+	placed.placement = {
+		.frame = frame,
+		.stepCount = static_cast<int>(stepCount),
+		.stepIndex = static_cast<int>(stepIndex),
+		.subStep = static_cast<int>(subStep),
+		.stepFraction = stepFraction,
+		.deltaFactor = deltaFactor
+	};
+	placed.maxSubSteps = static_cast<int>(maxSubSteps);
+	placed.maxExtraPasses = static_cast<int>(maxExtraPasses);
+	return true;
+}
+
+bool InputExportPlayer::foldable(const Input& press, const Input& release) {
+	return press.state == InputState::Press && release.state == InputState::Release
+		&& press.player == release.player && press.type == release.type;
+}
+
+bool InputExportPlayer::folded(const PlacedInput& press, const PlacedInput& release) {
+	// a folded release is applied right after its press with the same placement
+	return foldable(press.input, release.input)
+		&& press.placement.frame == release.placement.frame
+		&& press.placement.stepIndex == release.placement.stepIndex
+		&& press.placement.subStep == release.placement.subStep
+		&& press.placement.stepFraction == release.placement.stepFraction;
+}
+
+void InputExportPlayer::beginFrame(Engine& engine) {
+	// frame 0 is the warm-up, anything placed in it goes with frame 1
+	size_t end = next;
+	while (currentFrame && end < inputs.size() && inputs[end].placement.frame <= currentFrame) end++;
+
+	if (end != next) {
+		const PlacedInput& first = inputs[next];
+		stepCount = std::max(first.placement.stepCount, 1);
+		dualMode = first.dualMode;
+		engine.maxSubSteps = first.maxSubSteps;
+		engine.maxExtraPasses = first.maxExtraPasses;
+	}
+
+	// every input gets the range of queue times that puts it where it was placed:
+	// - a sub-step at fraction f of step i: exactly f into the step
+	// - one that was queued before the frame started: anywhere up to the frame start, it lands at step 0's start
+	// - one carried by step i: anywhere in the step, the last step also takes inputs on the frame end itself
+	// a press followed by a release of the same button within the coalescer's merge window is folded into it,
+	// so inside those ranges such pairs are kept further apart than that, unless they were folded when recorded.
+	// the window is mergeWindowFor, same as Engine::beginFrame
+	const Duration apart = mergeWindowFor(stepLength) + Duration(1);
+	queued.clear();
+	for (size_t i = next; i != end; i++) {
+		const InputPlacement& placement = inputs[i].placement;
+		const double fraction = std::clamp(placement.stepFraction, 0.0, 1.0);
+		const TimestampType stepStart = frameStart + stepLength * placement.stepIndex;
+
+		Queued slot;
+		if (fraction >= 1.0) {
+			slot.earliest = stepStart;
+			slot.latest = stepStart + stepLength - Duration(placement.stepIndex + 1 < stepCount);
+		}
+		else if (fraction <= 0.0 && placement.stepIndex == 0) {
+			slot.earliest = frameStart - stepLength * stepCount;
+			slot.latest = frameStart;
+		}
+		else slot.earliest = slot.latest = stepStart + Duration(std::llround(fraction * stepLength.count()));
+		queued.push_back(slot);
+	}
+
+	// the input ring keeps itself sorted, so every timeline's inputs stay in order. earliest times that do
+	// that and keep pairs apart front to back, then pulled earlier wherever that ran past a range
+	const size_t count = end - next;
+	Input last[2] = { lastQueued[0], lastQueued[1] };
+	const PlacedInput* lastPlaced[2] = {};
+	for (size_t i = 0; i < count; i++) {
+		const PlacedInput& placed = inputs[next + i];
+		const size_t timeline = dualMode ? static_cast<size_t>(placed.input.player) : 0;
+		Queued& slot = queued[i];
+
+		slot.time = slot.earliest;
+		if (lastPlaced[timeline] && folded(*lastPlaced[timeline], placed)) slot.time = last[timeline].time;
+		else if (last[timeline].time != TimestampType {}) {
+			const Duration gap = foldable(last[timeline], placed.input) ? apart : Duration::zero();
+			slot.time = std::min(std::max(slot.time, last[timeline].time + gap), slot.latest);
+		}
+
+		last[timeline] = placed.input;
+		last[timeline].time = slot.time;
+		lastPlaced[timeline] = &placed;
+	}
+	const PlacedInput* nextPlaced[2] = {};
+	TimestampType nextTime[2] = {};
+	for (size_t i = count; i-- > 0;) {
+		const PlacedInput& placed = inputs[next + i];
+		const size_t timeline = dualMode ? static_cast<size_t>(placed.input.player) : 0;
+		Queued& slot = queued[i];
+
+		if (nextPlaced[timeline]) {
+			if (folded(placed, *nextPlaced[timeline])) slot.time = nextTime[timeline];
+			else {
+				const Duration gap = foldable(placed.input, nextPlaced[timeline]->input) ? apart : Duration::zero();
+				slot.time = std::max(std::min(slot.time, nextTime[timeline] - gap), slot.earliest);
+			}
+		}
+		nextPlaced[timeline] = &placed;
+		nextTime[timeline] = slot.time;
+	}
+
+	for (size_t i = 0; i < count; i++, next++) {
+		Input input = inputs[next].input;
+		input.time = queued[i].time;
+		engine.addInput(input);
+		lastQueued[dualMode ? static_cast<size_t>(input.player) : 0] = input;
+	}
+
+	frameStart += stepLength * stepCount;
+	engine.cutoffMode = CutoffMode::Physics;
+	engine.beginLoop(frameStart);
+	engine.beginFrame(stepCount, dualMode, frameStart);
+	currentFrame++;
+}
+
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+// sub-frame input exports for replays and bots: every input CBF applied and exactly where inside the
+// physics steps it landed (InputPlacement), which tick based macro formats cant represent.
+// the writer is fed from the game thread and writes on a thread of its own, the reader decodes an
+// export held in memory and the player queues it back into an Engine in place of live input
+//
+// file layout: ExportHeader, then one record per applied input, in the order they were applied
+//   varint frames since the previous record's frame, the first one's since the frame that was running
+//   when the export started (frame 0)
+//   varint stepCount, stepIndex, subStep, maxSubSteps, maxExtraPasses
+//   stepFraction and deltaFactor as raw doubles, so they come back bit exact
+//   byte button | state << 2 | player << 3 | dualMode << 4
+
+#include <stdint.h>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace cbf {
+
+namespace input_export {
+
+constexpr char magic[8] = { 'C', 'B', 'F', 'I', 'N', 'P', 'U', 'T' };
+constexpr uint32_t version = 1;
+
+struct ExportHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+static_assert(sizeof(ExportHeader) == 16);
+
+}
+
+struct PlacedInput {
+    Input input; // its time isnt exported, the placement is what counts
+    InputPlacement placement; // frame counted from the start of the export
+    bool dualMode = false;
+    // the frame's sub-step caps, a replay needs the same ones for inputs to be carried the same way
+    int maxSubSteps = 0;
+    int maxExtraPasses = 0;
+};
+
+class InputExportWriter {
+public:
+    // the game thread hands a buffer over once it holds this much
+    static constexpr size_t flushSize = 16 * 1024;
+
+    InputExportWriter() = default;
+    ~InputExportWriter() { stop(); }
+    InputExportWriter(const InputExportWriter&) = delete;
+    InputExportWriter& operator=(const InputExportWriter&) = delete;
+
+    // frames are counted from firstFrame, an Engine::frameNumber. false (with error set) if path cant be created
+    bool start(const char* path, uint64_t firstFrame, std::string& error);
+    // writes out everything and closes the file, safe to call when not started
+    void stop();
+    bool running() const { return file != nullptr; }
+
+    // game thread, from a nextStep callback. only encodes into memory, never waits on the writer
+    void write(const Engine& engine, const Input& input, const InputPlacement& placement);
+
+    uint64_t inputs() const { return written; }
+
+private:
+    void handOff();
+
+    FILE* file = nullptr;
+    uint64_t lastFrame = 0;
+    uint64_t written = 0;
+
+    std::vector<uint8_t> buffer; // game thread
+    std::vector<uint8_t> pending; // handed to the writer, under mutex
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+};
+
+class InputExportReader {
+public:
+    // data has to outlive the reader
+    explicit InputExportReader(std::span<const uint8_t> data);
+
+    // false if the header is wrong, error() says why
+    bool valid() const { return lastError.empty(); }
+    const std::string& error() const { return lastError; }
+    // the export ended in the middle of a record or had one that didnt decode, everything after is lost
+    bool truncated() const { return cutOff; }
+
+    // next input in the order it was applied, false at the end
+    bool next(PlacedInput& placed);
+
+private:
+    std::span<const uint8_t> data;
+    size_t offset = 0;
+    uint64_t frame = 0;
+    bool cutOff = false;
+    std::string lastError;
+};
+
+// queues an export back into an Engine in place of live input, one frame at a time. frames run on a
+// clock of the player's own at 240 steps per second, and every input is queued at the time that puts it
+// at its recorded step fraction, so the planner places it the same way it was placed when recorded.
+// frame 0 only warms the engine up (the first frame after a reset is never stepped), export frame n is
+// the engine's frameNumber it started at + 1 + n
+class InputExportPlayer {
+public:
+    static constexpr Duration stepLength { 4'166'667 }; // 240 steps per second
+
+    // inputs must stay alive while playing
+    explicit InputExportPlayer(std::span<const PlacedInput> inputs) : inputs(inputs) {}
+
+    // starts the next frame on engine with its recorded inputs queued, stepping it is up to the caller.
+    // frames without inputs keep the step count and mode of the last one that had some
+    void beginFrame(Engine& engine);
+
+    uint64_t frame() const { return currentFrame; }
+    bool done() const { return next == inputs.size(); }
+
+private:
+    struct Queued {
+        TimestampType earliest {};
+        TimestampType latest {};
+        TimestampType time {};
+    };
+
+    // a press and release the coalescer would fold into one if queued close enough
+    static bool foldable(const Input& press, const Input& release);
+    // folded when recorded
+    static bool folded(const PlacedInput& press, const PlacedInput& release);
+
+    std::span<const PlacedInput> inputs;
+    std::vector<Queued> queued; // this frame's inputs
+    Input lastQueued[2] {}; // per timeline, from earlier frames
+    size_t next = 0;
+    uint64_t currentFrame = 0;
+    int stepCount = 4;
+    bool dualMode = false;
+    TimestampType frameStart = TimestampType(Duration(1'000'000'000)); // anywhere but the epoch, that means no input
+};
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+// a device inputs are captured from, on a thread of its own, and pushed into an Engine
+
+#include <optional>
+#include <string>
+
+#include "engine.hpp"
+#include "input_thread.hpp"
+
+namespace cbf {
+
+class InputSource {
+public:
+    // every source gets a queue lane of its own, so several can run at once without sharing a lock
+    explicit InputSource(Engine& engine) : engine(engine), lane(engine.inputQueue.claimLane()) {}
+    virtual ~InputSource() {
+        if (lane) engine.inputQueue.releaseLane(*lane);
+    }
+
+    InputSource(const InputSource&) = delete;
+    InputSource& operator=(const InputSource&) = delete;
+
+    // starts capturing, false (with error() set) if the device cant be used
+    virtual bool start() = 0;
+    // stops capturing and waits for the capture thread, safe to call when not started
+    // subclasses must call it from their own destructor, the thread cant outlive them
+    virtual void stop() = 0;
+
+    // the kind of clock the source's event timestamps come from
+    virtual ClockSource clock() const = 0;
+    // human readable device identity, eg. name and bus/vendor/product ids
+    virtual std::string identity() const = 0;
+
+    const std::string& error() const { return lastError; }
+    const ClockAligner& clockAligner() const { return aligner; }
+
+    // takes effect on the next start(), the capture thread applies it to itself
+    void setThreadPolicy(const InputThreadPolicy& policy) { threadPolicy = policy; }
+    // what of the policy couldnt be applied, set by the time start() returns
+    const std::string& threadPolicyError() const { return policyError; }
+
+    LatencyHistogram wakeupLatency; // capture thread woke up -> its inputs are queued
+    LatencyHistogram eventLatency; // event timestamp -> input queued
+
+protected:
+    // false if every lane was already taken when the source was created
+    bool hasLane() const { return lane.has_value(); }
+
+    // capture thread only
+    void push(Input input, TimestampType receiveTime) {
+        const TimestampType eventTime = input.time;
+        input.time = aligner.align(input.time, receiveTime);
+        engine.addInput(input, *lane, eventTime, receiveTime);
+        eventLatency.record(getCurrentTime() - input.time);
+    }
+
+    Engine& engine;
+    std::string lastError;
+    InputThreadPolicy threadPolicy;
+    std::string policyError;
+
+private:
+    // devices of the same kind can still be on different clocks, so each source aligns its own
+    ClockAligner aligner;
+    std::optional<size_t> lane;
+};
+
+}
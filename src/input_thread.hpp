@@ -0,0 +1,66 @@
+#pragma once
+
+// how an input thread is scheduled, and how long inputs take to get through it
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <string>
+
+#include "engine.hpp"
+
+namespace cbf {
+
+struct InputThreadPolicy {
+    bool highPriority = false; // time critical on windows, SCHED_FIFO on linux
+    int core = -1; // pin the thread to this cpu, -1 leaves it to the os
+    bool busyPoll = false; // spin instead of sleeping while there is no input, costs a whole core
+};
+
+// applies policy to the calling thread. whatever cant be applied is skipped and described in error,
+// false if anything was. implemented once per platform like getCurrentTime (windows.cpp, linux.cpp)
+bool applyInputThreadPolicy(const InputThreadPolicy& policy, std::string& error);
+
+// log2 histogram of a latency: bucket 0 is under 1us, bucket i is [2^(i-1), 2^i)us and the last one
+// takes everything longer. record() is for a single thread, the rest can be read from anywhere
+class LatencyHistogram {
+public:
+    static constexpr size_t bucketCount = 24;
+
+    void record(Duration latency) {
+        const int64_t ns = std::max<int64_t>(latency.count(), 0);
+        const size_t bucket = std::min<size_t>(std::bit_width(static_cast<uint64_t>(ns / 1000)), bucketCount - 1);
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        if (ns > maxNs.load(std::memory_order_relaxed)) maxNs.store(ns, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (const auto& bucket : buckets) total += bucket.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // upper edge of the bucket the fraction-th latency is in, never more than max()
+    Duration percentile(double fraction) const {
+        const uint64_t total = count();
+        if (!total) return {};
+
+        const uint64_t rank = static_cast<uint64_t>(std::clamp(fraction, 0.0, 1.0) * (total - 1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i + 1 < bucketCount; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > rank) return std::min(max(), Duration((int64_t(1) << i) * 1000));
+        }
+        return max();
+    }
+
+    Duration max() const { return Duration(maxNs.load(std::memory_order_relaxed)); }
+
+private:
+    std::array<std::atomic<uint64_t>, bucketCount> buckets {};
+    std::atomic<int64_t> maxNs = 0;
+};
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// keybind lookup for the input thread, rebuilt by the game thread and swapped in whole
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "engine.hpp"
+
+namespace cbf {
+
+// what every key is bound to, indexed directly by key code (virtual key codes on windows)
+// immutable once published, so the input thread can read it without a lock
+class KeybindTable {
+public:
+    static constexpr size_t keyCount = 256;
+
+    struct Binding {
+        bool bound = false;
+        Player player = Player::Player1;
+        PlayerButton button = PlayerButton::Jump;
+    };
+
+    // the first bind of a key wins, so bind in priority order (p1 before p2, jump before left/right)
+    void bind(uint32_t key, Player player, PlayerButton button) {
+        if (key >= keyCount || bindings[key].bound) return;
+        bindings[key] = Binding { true, player, button };
+    }
+
+    const Binding& find(uint32_t key) const {
+        static constexpr Binding unbound {};
+        return key < keyCount ? bindings[key] : unbound;
+    }
+
+    bool rightClick = false; // right click is p2 jump
+
+private:
+    std::array<Binding, keyCount> bindings {};
+};
+
+// a value published by one writer and read by exactly one reader thread without locking
+// the writer swaps the pointer and only frees the old value once the reader isnt holding it
+// (a single hazard pointer), so the reader never waits and never touches freed memory
+template <typename T>
+class Published {
+public:
+    class Reader {
+    public:
+        explicit Reader(const Published& source) : source(source) {
+            const T* value = source.current.load(std::memory_order_acquire);
+            while (true) {
+                source.hazard.store(value, std::memory_order_seq_cst);
+                const T* check = source.current.load(std::memory_order_seq_cst);
+                if (check == value) break;
+                value = check;
+            }
+            this->value = value;
+        }
+
+        ~Reader() { source.hazard.store(nullptr, std::memory_order_release); }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const T& operator*() const { return *value; }
+        const T* operator->() const { return value; }
+
+    private:
+        const Published& source;
+        const T* value;
+    };
+
+    Published() : current(new T()) {}
+    ~Published() { delete current.load(); }
+
+    Published(const Published&) = delete;
+    Published& operator=(const Published&) = delete;
+
+    // reader side, the value stays valid until the Reader goes away
+    Reader read() const { return Reader(*this); }
+
+    // writer side, can spin for as long as the reader holds the old value (a few lookups)
+    void publish(std::unique_ptr<T> value) {
+        const T* old = current.exchange(value.release(), std::memory_order_seq_cst);
+        while (hazard.load(std::memory_order_seq_cst) == old) std::this_thread::yield();
+        delete old;
+    }
+
+private:
+    std::atomic<const T*> current;
+    mutable std::atomic<const T*> hazard = nullptr;
+};
+
+}
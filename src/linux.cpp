@@ -0,0 +1,58 @@
+// frame clock for the headless build (CLOCK_MONOTONIC, same as the android side)
+// and input thread scheduling for the evdev source
+
+#include <time.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "engine.hpp"
+#include "input_thread.hpp"
+
+cbf::TimestampType cbf::getCurrentTime() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return TimestampType(std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec));
+}
+
+bool cbf::applyInputThreadPolicy(const InputThreadPolicy& policy, std::string& error) {
+	error.clear();
+#ifdef __linux__
+	auto fail = [&](const char* what, int err) {
+		if (!error.empty()) error += ", ";
+		error += std::string(what) + ": " + strerror(err);
+	};
+
+	if (policy.highPriority) {
+		// a busy polling SCHED_FIFO thread would starve everything else on its core, so it only gets the best nice value
+		if (policy.busyPoll) {
+			if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), -20) != 0) fail("setpriority", errno);
+		}
+		else {
+			sched_param param {};
+			param.sched_priority = std::min(50, sched_get_priority_max(SCHED_FIFO));
+			if (const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) fail("SCHED_FIFO", err);
+		}
+	}
+
+	if (policy.core >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		if (policy.core >= CPU_SETSIZE) fail("affinity", EINVAL);
+		else {
+			CPU_SET(policy.core, &cpus);
+			if (const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) fail("affinity", err);
+		}
+	}
+#else
+	if (policy.highPriority || policy.core >= 0) error = "thread priority and affinity are only implemented on linux";
+#endif
+	return error.empty();
+}
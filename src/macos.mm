@@ -11,19 +11,25 @@
 #include <time.h>
 
 #include "platform.hpp"
+#include "trace.hpp"
 
 using namespace geode::prelude;
 
 cbf::TimestampType cbf::getCurrentTime() {
-	// convert ns to ms
-	return clock_gettime_nsec_np(CLOCK_UPTIME_RAW) / 1'000'000;
+	return cbf::TimestampType(cbf::Duration(clock_gettime_nsec_np(CLOCK_UPTIME_RAW)));
+}
+
+// NSEvent timestamps are seconds since boot on the same clock
+cbf::TimestampType eventTime(NSEvent* event) {
+	return cbf::TimestampType(std::chrono::duration_cast<cbf::Duration>(std::chrono::duration<double>([event timestamp])));
 }
 
 void addInput(cbf::TimestampType time, bool down) {
     auto& manager = cbf::Manager::get();
     auto state = down ? cbf::InputState::Press : cbf::InputState::Release;
+    CBF_TRACE_INSTANT(Input, 1);
     // log::debug("input timestamp is {}, state {}", g_lastTimestamp, int(state));
-    manager.addInput(cbf::Input { .time = time, .state = state });
+    manager.addInput(cbf::Input { .time = time, .state = state }, cbf::ClockSource::Mouse);
 }
 
 @interface EAGLView : NSOpenGLView
@@ -31,7 +37,7 @@ void addInput(cbf::TimestampType time, bool down) {
 
 static IMP keyDownExecOIMP;
 void keyDownExec(EAGLView* self, SEL sel, NSEvent* event) {
-	auto timestamp = static_cast<cbf::TimestampType>([event timestamp] * 1000.0);
+	auto timestamp = eventTime(event);
     // this would jump with any key, oops
 	// addInput(timestamp, true);
 
@@ -40,7 +46,7 @@ void keyDownExec(EAGLView* self, SEL sel, NSEvent* event) {
 
 static IMP keyUpExecOIMP;
 void keyUpExec(EAGLView* self, SEL sel, NSEvent* event) {
-	auto timestamp = static_cast<cbf::TimestampType>([event timestamp] * 1000.0);
+	auto timestamp = eventTime(event);
 	// addInput(timestamp, false);
 
 	reinterpret_cast<decltype(&keyUpExec)>(keyUpExecOIMP)(self, sel, event);
@@ -48,7 +54,7 @@ void keyUpExec(EAGLView* self, SEL sel, NSEvent* event) {
 
 static IMP mouseDownExecOIMP;
 void mouseDownExec(EAGLView* self, SEL sel, NSEvent* event) {
-	auto timestamp = static_cast<cbf::TimestampType>([event timestamp] * 1000.0);
+	auto timestamp = eventTime(event);
 	addInput(timestamp, true);
 
 	reinterpret_cast<decltype(&mouseDownExec)>(mouseDownExecOIMP)(self, sel, event);
@@ -56,7 +62,7 @@ void mouseDownExec(EAGLView* self, SEL sel, NSEvent* event) {
 
 static IMP mouseUpExecOIMP;
 void mouseUpExec(EAGLView* self, SEL sel, NSEvent* event) {
-	auto timestamp = static_cast<cbf::TimestampType>([event timestamp] * 1000.0);
+	auto timestamp = eventTime(event);
 	addInput(timestamp, false);
 
 	reinterpret_cast<decltype(&mouseUpExec)>(mouseUpExecOIMP)(self, sel, event);
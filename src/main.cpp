@@ -1,6 +1,7 @@
-#include <queue>
 #include <algorithm>
-#include <limits>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
 #include <mutex>
 
 #include <Geode/Geode.hpp>
@@ -12,10 +13,18 @@
 #include <Geode/modify/PlayerObject.hpp>
 #include <Geode/modify/EndLevelLayer.hpp>
 
+#include "../include/events.hpp"
 #include "platform.hpp"
+#include "trace.hpp"
 
 using namespace geode::prelude;
 
+// only two player levels give p2 inputs of its own, a regular dual portal mirrors p1's onto it
+// so both players have to keep stepping together
+bool splitsTimelines(PlayLayer* playLayer) {
+	return playLayer->m_gameState.m_isDualMode && playLayer->m_levelSettings->m_twoPlayerMode;
+}
+
 void updateInputQueueAndTime(int stepCount) {
 	PlayLayer* playLayer = PlayLayer::get();
 	auto& manager = cbf::Manager::get();
@@ -24,94 +33,54 @@ void updateInputQueueAndTime(int stepCount) {
 		|| playLayer->m_player1->m_isDead) 
 	{
 		manager.enableInput = true;
-		manager.firstFrame = true;
-		manager.skipUpdate = true;
+		manager.engine.suspend();
 		return;
 	}
 	else {
-		manager.nextInput = {};
-		manager.lastFrameTime = manager.lastPhysicsFrameTime;
-		manager.stepQueue = {};
-		// std::queue<struct step>().swap(stepQueue); // just in case
-
-		{
-			std::lock_guard lock(manager.inputQueueLock);
-			
-			if (manager.lateCutoff) {
-				manager.currentFrameTime = cbf::getCurrentTime();
-				// QueryPerformanceCounter(&currentFrameTime); // done within the critical section to prevent a race condition which could cause dropped inputs
-				manager.inputQueueCopy = manager.inputQueue;
-				manager.inputQueue = {};
-				// std::queue<struct inputEvent>().swap(inputQueue);
-			}
-			else {
-				while (!manager.inputQueue.empty() && manager.inputQueue.front().time <= manager.currentFrameTime) {
-					manager.inputQueueCopy.push(manager.inputQueue.front());
-					manager.inputQueue.pop();
-				}
-			}
-		}
+		manager.stepCost.endFrame();
 
-		manager.lastPhysicsFrameTime = manager.currentFrameTime;
+#ifdef CBF_VALIDATE_TIMING
+		const double lastMax = manager.engine.timingValidator.maxDifference;
+#endif
 
-		if (!manager.firstFrame) manager.skipUpdate = false;
-		else {
-			manager.skipUpdate = true;
-			manager.firstFrame = false;
-			if (!manager.lateCutoff) std::queue<cbf::Input>().swap(manager.inputQueueCopy);
-			return;
-		}
+		manager.engine.beginFrame(stepCount, splitsTimelines(playLayer), cbf::getCurrentTime());
 
-		cbf::TimestampType deltaTime = manager.currentFrameTime - manager.lastFrameTime;
-		cbf::TimestampType stepDelta = (deltaTime / stepCount) + 1; // the +1 is to prevent dropped inputs caused by integer division
-
-		constexpr double smallestFloat = std::numeric_limits<float>::min(); // ensures deltaFactor can never be 0, even after being converted to float
-		for (int i = 0; i < stepCount; i++) {
-			double lastDFactor = 0.0;
-			while (true) {
-				cbf::Input front;
-				if (!manager.inputQueueCopy.empty()) {
-					front = manager.inputQueueCopy.front();
-					if (front.time - manager.lastFrameTime < stepDelta * (i + 1)) {
-						double dFactor = static_cast<double>((front.time - manager.lastFrameTime) % stepDelta) / stepDelta;
-						manager.stepQueue.emplace(cbf::Step { front, std::clamp(dFactor - lastDFactor, smallestFloat, 1.0), false });
-						lastDFactor = dFactor;
-						manager.inputQueueCopy.pop();
-						continue;
-					}
-				}
-				front = manager.nextInput;
-				manager.stepQueue.emplace(cbf::Step { front, std::max(smallestFloat, 1.0 - lastDFactor), true });
-				break;
-			}
+#ifdef CBF_VALIDATE_TIMING
+		const auto& validator = manager.engine.timingValidator;
+		if (validator.maxDifference > lastMax) {
+			log::info("timing validation: max deltaFactor difference vs old split is now {:.6f} ({} inputs compared)", validator.maxDifference, validator.inputsCompared);
 		}
+#endif
 	}
 }
 
 // bool enableP1CollisionAndRotation = true;
 // bool enableP2CollisionAndRotation = true;
 
-cbf::Step updateDeltaFactorAndInput() {
+cbf::Step updateDeltaFactorAndInput(cbf::Timeline& timeline) {
 	auto& manager = cbf::Manager::get();
 	manager.enableInput = false;
 
-	if (manager.stepQueue.empty()) return {};
-
-	auto front = manager.stepQueue.front();
-	double deltaFactor = front.deltaFactor;
-
-	if (manager.nextInput.time != 0) {
+	return manager.engine.nextStep(timeline, [&](const cbf::Input& input, const cbf::InputPlacement& placement) {
 		PlayLayer* playLayer = PlayLayer::get();
 
+		manager.inputExport.write(manager.engine, input, placement);
+		cbf::InputAppliedEvent(cbf::AppliedInput {
+			.frame = placement.frame,
+			.stepCount = placement.stepCount,
+			.stepIndex = placement.stepIndex,
+			.subStep = placement.subStep,
+			.stepFraction = placement.stepFraction,
+			.deltaFactor = placement.deltaFactor,
+			.button = static_cast<int>(input.type),
+			.down = input.state == cbf::InputState::Press,
+			.player1 = input.player == cbf::Player::Player1
+		}).post();
+
 		manager.enableInput = true;
-		playLayer->handleButton(!manager.nextInput.state, (int)manager.nextInput.type, manager.nextInput.player == cbf::Player::Player1);
+		playLayer->handleButton(!input.state, (int)input.type, input.player == cbf::Player::Player1);
 		manager.enableInput = false;
-	}
-
-	manager.nextInput = front.input;
-	manager.stepQueue.pop();
-
-	return front;
+	});
 }
 
 void clearQueuesBeforeLoop() {
@@ -119,24 +88,16 @@ void clearQueuesBeforeLoop() {
 	CCNode* par;
 	auto& manager = cbf::Manager::get();
 
-	if (!manager.lateCutoff) manager.currentFrameTime = cbf::getCurrentTime();
+	CBF_TRACE_SCOPE(ClearQueues);
+	manager.engine.beginLoop(cbf::getCurrentTime());
 
 	if (manager.softToggle 
 		|| !playLayer 
 		|| !(par = playLayer->getParent()) 
 		|| (getChildOfType<PauseLayer>(par, 0) != nullptr)) 
 	{
-		manager.firstFrame = true;
-		manager.skipUpdate = true;
 		manager.enableInput = true;
-
-		std::queue<cbf::Input>().swap(manager.inputQueueCopy);
-
-		{
-			std::lock_guard lock(manager.inputQueueLock);
-			manager.inputQueue = {};
-			// std::queue<struct inputEvent>().swap(inputQueue);
-		}
+		manager.engine.reset();
 	}
 }
 #ifndef GEODE_IS_WINDOWS
@@ -192,9 +153,10 @@ class $modify(GJBaseGameLayer) {
 			if (manager.actualDelta) modifiedDelta = CCDirector::sharedDirector()->getActualDeltaTime() * timewarp;
 			
 			const int stepCount = std::round(std::max(1.0, ((modifiedDelta * 60.0) / std::min(1.0f, timewarp)) * 4)); // not sure if this is different from (delta * 240) / timewarp
+			manager.recorder.setGameInfo({ modifiedDelta, timewarp, manager.actualDelta });
 
 			if (modifiedDelta > 0.0) updateInputQueueAndTime(stepCount);
-			else manager.skipUpdate = true;
+			else manager.engine.skipUpdate = true;
 		}
 		
 		return modifiedDelta;
@@ -207,7 +169,7 @@ class $modify(PlayerObject) {
 		PlayLayer* pl = PlayLayer::get();
 		auto& manager = cbf::Manager::get();
 
-		if (manager.skipUpdate 
+		if (manager.engine.skipUpdate 
 			|| !pl 
 			|| !(this == pl->m_player1 || this == pl->m_player2))
 		{
@@ -227,67 +189,107 @@ class $modify(PlayerObject) {
 			|| (p2->m_isDart || p2->m_isBird || p2->m_isShip || p2->m_isSwing);
 
 		bool isDual = pl->m_gameState.m_isDualMode;
+		bool splitTimelines = splitsTimelines(pl);
 
 		manager.p1Pos = PlayerObject::getPosition();
 		manager.p2Pos = p2->getPosition();
 
+		auto updateP2 = [&](const cbf::Step& step, float newTimeFactor) {
+			if (p2NotBuffering) {
+				uint64_t started = manager.stepCost.start();
+				p2->update(newTimeFactor);
+				started = manager.stepCost.lap(cbf::CostPhase::Update, !step.endStep, started);
+				if (!step.endStep) {
+					CBF_TRACE_SCOPE(ExtraPass, 2);
+					manager.p2CollisionDelta = newTimeFactor;
+					pl->checkCollisions(p2, 0.0f, true);
+					started = manager.stepCost.lap(cbf::CostPhase::Collisions, true, started);
+					p2->updateRotation(newTimeFactor);
+					started = manager.stepCost.lap(cbf::CostPhase::Rotation, true, started);
+					newResetCollisionLog(p2);
+					manager.stepCost.lap(cbf::CostPhase::ResetCollisionLog, true, started);
+				}
+			}
+			else if (step.endStep) {
+				const uint64_t started = manager.stepCost.start();
+				p2->update(timeFactor);
+				manager.stepCost.lap(cbf::CostPhase::Update, false, started);
+			}
+		};
+
 		cbf::Step step;
 		manager.midStep = true;
 
 		do {
-			step = updateDeltaFactorAndInput();
+			CBF_TRACE_SCOPE(SubStep, 1);
+			step = updateDeltaFactorAndInput(manager.engine.timelines[0]);
 
 			const float newTimeFactor = timeFactor * step.deltaFactor;
-			manager.rotationDelta = newTimeFactor;
+			manager.p1RotationDelta = newTimeFactor;
+			if (!splitTimelines) manager.p2RotationDelta = newTimeFactor;
 
 			if (p1NotBuffering) {
-				if (step.deltaFactor != 1.0)
-					log::debug("inserting new time step at {:.3f} - delta {:.5f}", newTimeFactor, step.deltaFactor);
+				if (step.deltaFactor != 1.0) manager.gameLog.write(cbf::LogMessage::SubStep, newTimeFactor, step.deltaFactor);
+				uint64_t started = manager.stepCost.start();
 				PlayerObject::update(newTimeFactor);
+				started = manager.stepCost.lap(cbf::CostPhase::Update, !step.endStep, started);
 				if (!step.endStep) {
+					CBF_TRACE_SCOPE(ExtraPass, 1);
 					manager.p1CollisionDelta = newTimeFactor;
 					pl->checkCollisions(this, 0.0f, true);
+					started = manager.stepCost.lap(cbf::CostPhase::Collisions, true, started);
 					PlayerObject::updateRotation(newTimeFactor);
+					started = manager.stepCost.lap(cbf::CostPhase::Rotation, true, started);
 					newResetCollisionLog(this);
+					manager.stepCost.lap(cbf::CostPhase::ResetCollisionLog, true, started);
 				}
 			}
 			else if (step.endStep) { // disable cbf for buffers, revert to click-on-steps mode 
+				const uint64_t started = manager.stepCost.start();
 				PlayerObject::update(timeFactor);
+				manager.stepCost.lap(cbf::CostPhase::Update, false, started);
 			}
 
-			if (isDual) {
-				if (p2NotBuffering) {
-					p2->update(newTimeFactor);
-					if (!step.endStep) {
-						manager.p2CollisionDelta = newTimeFactor;
-						pl->checkCollisions(p2, 0.0f, true);
-						p2->updateRotation(newTimeFactor);
-						newResetCollisionLog(p2);
-					}
-				}
-				else if (step.endStep) {
-					p2->update(timeFactor);
-				}
-			}
-
+			if (isDual && !splitTimelines) updateP2(step, newTimeFactor);
 		} while (!step.endStep);
 
+		// in two player levels p2 walks its own timeline, so p1's inputs dont sub-step it and both still end on the same frame time
+		// (if dual mode only started this frame, its timeline is empty and p2 just takes whole steps)
+		if (splitTimelines) {
+			do {
+				CBF_TRACE_SCOPE(SubStep, 2);
+				step = updateDeltaFactorAndInput(manager.engine.timelines[1]);
+
+				const float newTimeFactor = timeFactor * step.deltaFactor;
+				manager.p2RotationDelta = newTimeFactor;
+
+				updateP2(step, newTimeFactor);
+			} while (!step.endStep);
+		}
+
 		manager.midStep = false;
 	}
 
 	void updateRotation(float t) {
 		auto& manager = cbf::Manager::get();
 		PlayLayer* pl = PlayLayer::get();
-		if (!manager.skipUpdate && pl && this == pl->m_player1) {
-			PlayerObject::updateRotation(manager.rotationDelta);
+		if (!manager.engine.skipUpdate && pl && this == pl->m_player1) {
+			CBF_TRACE_SCOPE(Rotation, 1);
+			const uint64_t started = manager.stepCost.start();
+			PlayerObject::updateRotation(manager.p1RotationDelta);
+			manager.stepCost.lap(cbf::CostPhase::Rotation, false, started);
 
 			if (manager.p1Pos.x && !manager.midStep) { // to happen only when GJBGL::update() calls updateRotation after an input
 				this->m_lastPosition = manager.p1Pos;
 				manager.p1Pos.setPoint(0.f, 0.f);
 			}
 		}
-		else if (!manager.skipUpdate && pl && this == pl->m_player2) {
-			PlayerObject::updateRotation(manager.rotationDelta);
+		else if (!manager.engine.skipUpdate && pl && this == pl->m_player2) {
+			CBF_TRACE_SCOPE(Rotation, 2);
+			// p2's extra passes come through here too, they are timed by the update hook
+			const uint64_t started = manager.midStep ? 0 : manager.stepCost.start();
+			PlayerObject::updateRotation(manager.p2RotationDelta);
+			manager.stepCost.lap(cbf::CostPhase::Rotation, false, started);
 
 			if (manager.p2Pos.x && !manager.midStep) {
 				pl->m_player2->m_lastPosition = manager.p2Pos;
@@ -298,6 +300,109 @@ class $modify(PlayerObject) {
 	}
 };
 
+// the hot paths only record what they logged, this is where it becomes text
+// runs on the log flusher while debug-log is on, and at level end
+void flushDeferredLogs() {
+	auto& manager = cbf::Manager::get();
+	auto write = [](const cbf::LogRecord& record) {
+		log::debug("{}", fmt::format(fmt::runtime(cbf::logFormats[static_cast<size_t>(record.message)]), record.args[0], record.args[1]));
+	};
+	manager.gameLog.drain(write);
+	manager.inputLog.drain(write);
+}
+
+// what sub-stepping cost since the level started or was last logged, at level end and when it is exited
+void logStepCost() {
+	auto& cost = cbf::Manager::get().stepCost;
+	if (!cost.isEnabled() || !cost.passes.count()) return;
+
+	const auto& regular = cost.regularTicks;
+	const auto& extra = cost.extraTicks;
+	const double total = static_cast<double>(regular.sum() + extra.sum());
+	log::info("sub-step cost over {} frames: extra passes {:.1f}us/frame (p99 <{:.0f}us, max {:.0f}us), regular steps {:.1f}us/frame (p99 <{:.0f}us), {:.1f}% of player update time is extra passes",
+		cost.passes.count(), cost.micros(extra.mean()), cost.micros(extra.percentile(0.99)), cost.micros(extra.max()),
+		cost.micros(regular.mean()), cost.micros(regular.percentile(0.99)), total ? extra.sum() / total * 100.0 : 0.0);
+	log::info("player update passes per frame: {:.1f} (p99 {}, max {}), of which extra: {:.1f} (p99 {}, max {})",
+		cost.passes.mean(), cost.passes.percentile(0.99), cost.passes.max(),
+		cost.extraPasses.mean(), cost.extraPasses.percentile(0.99), cost.extraPasses.max());
+
+	const auto& phases = cost.phaseTicks;
+	log::info("extra passes by phase: {} {:.0f}us, {} {:.0f}us, {} {:.0f}us, {} {:.0f}us. regular steps: {} {:.0f}us, {} {:.0f}us",
+		cbf::costPhaseNames[0], cost.micros(phases[1][0]), cbf::costPhaseNames[1], cost.micros(phases[1][1]),
+		cbf::costPhaseNames[2], cost.micros(phases[1][2]), cbf::costPhaseNames[3], cost.micros(phases[1][3]),
+		cbf::costPhaseNames[0], cost.micros(phases[0][0]), cbf::costPhaseNames[2], cost.micros(phases[0][2]));
+	cost.clear();
+}
+
+// sub-step cost of the last half second, in PlayLayer's top left corner
+class StepCostOverlay : public CCNode {
+public:
+	static StepCostOverlay* create() {
+		auto ret = new StepCostOverlay();
+		if (ret->init()) {
+			ret->autorelease();
+			return ret;
+		}
+		delete ret;
+		return nullptr;
+	}
+
+	bool init() override {
+		if (!CCNode::init()) return false;
+
+		label = CCLabelBMFont::create("", "bigFont.fnt");
+		label->setAnchorPoint({ 0.0f, 1.0f });
+		label->setOpacity(160);
+		label->setScale(0.25f);
+		this->addChild(label);
+
+		this->scheduleUpdate();
+		return true;
+	}
+
+	void update(float dt) override {
+		elapsed += dt;
+		if (elapsed < 0.5f) return;
+		elapsed = 0.0f;
+
+		auto& cost = cbf::Manager::get().stepCost;
+		const auto window = cost.takeWindow();
+		if (!window.frames) return;
+
+		const double frames = static_cast<double>(window.frames);
+		const double total = static_cast<double>(window.ticks[0] + window.ticks[1]);
+		label->setString(fmt::format("CBF extra passes: {:.2f}ms/frame ({:.0f}%), worst {:.2f}ms\n{:.1f} passes/frame, {:.1f} extra",
+			cost.micros(window.ticks[1] / frames) / 1000.0, total ? window.ticks[1] / total * 100.0 : 0.0, cost.micros(window.maxExtraTicks) / 1000.0,
+			(window.passes[0] + window.passes[1]) / frames, window.passes[1] / frames).c_str());
+	}
+
+private:
+	CCLabelBMFont* label = nullptr;
+	float elapsed = 0.0f;
+};
+
+class $modify(StepCostPlayLayer, PlayLayer) {
+	bool init(GJGameLevel* level, bool useReplay, bool dontCreateObjects) {
+		if (!PlayLayer::init(level, useReplay, dontCreateObjects)) return false;
+
+		// every level is measured on its own, attempts add up
+		cbf::Manager::get().stepCost.clear();
+		if (Mod::get()->getSettingValue<bool>("substep-overlay")) {
+			if (auto overlay = StepCostOverlay::create()) {
+				const cocos2d::CCSize size = cocos2d::CCDirector::sharedDirector()->getWinSize();
+				overlay->setPosition({ 4.0f, size.height - 4.0f });
+				this->addChild(overlay, 1000);
+			}
+		}
+		return true;
+	}
+
+	void onQuit() {
+		logStepCost();
+		PlayLayer::onQuit();
+	}
+};
+
 class $modify(EndLevelLayer) {
 	void customSetup() {
 		auto& manager = cbf::Manager::get();
@@ -320,9 +425,116 @@ class $modify(EndLevelLayer) {
 
 			this->addChild(indicator);
 		}
+
+		// whatever the level logged goes before its stats
+		flushDeferredLogs();
+
+		if (!manager.softToggle) {
+			uint64_t catchUpFrames = 0, catchUpInputs = 0, cappedInputs = 0, droppedInputs = 0, mergedInputs = 0;
+			for (auto& timeline : manager.engine.timelines) {
+				catchUpFrames += timeline.stepGenerator.catchUpFrames;
+				catchUpInputs += timeline.stepGenerator.catchUpInputs;
+				cappedInputs += timeline.stepGenerator.cappedInputs;
+				droppedInputs += timeline.coalescer.droppedInputs;
+				mergedInputs += timeline.coalescer.mergedInputs;
+			}
+
+			log::info("steps never reached: {}, frames over the sub-step cap: {}, inputs moved to a step boundary: {} (+{} over the pass cap)",
+				manager.engine.leftoverSteps, catchUpFrames, catchUpInputs, cappedInputs);
+			log::info("duplicate inputs dropped: {}, releases merged into their press: {}", droppedInputs, mergedInputs);
+
+			const auto& queue = manager.engine.inputQueue;
+			log::info("inputs reordered: {} (deepest {}), too late to reorder: {}, queue overflows: {}, queued after their cutoff: {}",
+				queue.reordered(), queue.maxDepth(), queue.late(), queue.overflows(), queue.afterCutoff());
+
+			if (const auto& predictor = manager.engine.cutoffPredictor; predictor.frames()) {
+				log::info("adaptive cutoff: {}us before the physics update on average, safety margin {}us, {} inputs deferred",
+					predictor.meanCutoffMargin().count() / 1000, predictor.margin().count() / 1000, predictor.deferredInputs());
+			}
+
+			if (const auto& latency = manager.inputLatency; latency.count()) {
+				log::info("input thread wakeup to enqueue: p50 <{}us, p99 <{}us, max {}us",
+					latency.percentile(0.5).count() / 1000, latency.percentile(0.99).count() / 1000, latency.max().count() / 1000);
+			}
+
+			for (size_t i = 0; i < std::size(manager.engine.clockAligners); i++) {
+				const auto& aligner = manager.engine.clockAligners[i];
+				if (!aligner.aligned() && !aligner.missing() && !aligner.rejected()) continue;
+
+				log::info("{} timestamps: {} aligned ({} clamped), {} missing, {} rejected, {} resyncs, offset {}us, drift {:.1f}ppm",
+					cbf::clockSourceNames[i], aligner.aligned(), aligner.corrected(), aligner.missing(), aligner.rejected(),
+					aligner.resyncs(), aligner.offset().count() / 1000, aligner.drift());
+			}
+
+			if (const uint64_t dropped = manager.gameLog.dropped() + manager.inputLog.dropped()) {
+				log::info("debug messages dropped: {}", dropped);
+			}
+
+			logStepCost();
+		}
 	}
 };
 
+void setDebugLog(bool enable) {
+	auto& manager = cbf::Manager::get();
+	manager.gameLog.setEnabled(enable);
+	manager.inputLog.setEnabled(enable);
+
+	// the logs are off before the flusher stops, so its last flush gets everything
+	if (enable) manager.logFlusher.start(std::chrono::milliseconds(250), flushDeferredLogs);
+	else manager.logFlusher.stop();
+}
+
+// called from the setting, so on the game thread and never in the middle of a frame
+void setRecording(bool enable) {
+	auto& manager = cbf::Manager::get();
+	if (enable == manager.recorder.running()) return;
+
+	if (!enable) {
+		manager.engine.recorder = nullptr;
+		manager.recorder.stop();
+		log::info("Recording stopped, {} bytes written, {} events dropped", manager.recorder.bytesWritten(), manager.recorder.dropped());
+		return;
+	}
+
+	const auto dir = Mod::get()->getSaveDir() / "recordings";
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	const auto path = dir / fmt::format("session-{}.cbfrec", std::time(nullptr));
+
+	std::string error;
+	if (!manager.recorder.start(path.string().c_str(), error)) {
+		log::warn("Recording failed to start: {}", error);
+		return;
+	}
+	manager.engine.recorder = &manager.recorder;
+	log::info("Recording to {}", path.string());
+}
+
+// same as setRecording
+void setInputExport(bool enable) {
+	auto& manager = cbf::Manager::get();
+	if (enable == manager.inputExport.running()) return;
+
+	if (!enable) {
+		manager.inputExport.stop();
+		log::info("Input export stopped, {} inputs written", manager.inputExport.inputs());
+		return;
+	}
+
+	const auto dir = Mod::get()->getSaveDir() / "exports";
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	const auto path = dir / fmt::format("inputs-{}.cbfinput", std::time(nullptr));
+
+	std::string error;
+	if (!manager.inputExport.start(path.string().c_str(), manager.engine.frameNumber, error)) {
+		log::warn("Input export failed to start: {}", error);
+		return;
+	}
+	log::info("Exporting inputs to {}", path.string());
+}
+
 Patch* patch = nullptr;
 
 void toggleMod(bool disable) {
@@ -341,18 +553,72 @@ void toggleMod(bool disable) {
 	manager.softToggle = disable;
 }
 
+// the overlay needs the measurements too
+void updateStepCost() {
+	cbf::Manager::get().stepCost.setEnabled(Mod::get()->getSettingValue<bool>("substep-profiler") || Mod::get()->getSettingValue<bool>("substep-overlay"));
+}
+
+// adaptive overrides late
+void updateCutoffMode() {
+	auto& engine = cbf::Manager::get().engine;
+	if (Mod::get()->getSettingValue<bool>("adaptive-cutoff")) engine.cutoffMode = cbf::CutoffMode::Adaptive;
+	else if (Mod::get()->getSettingValue<bool>("late-cutoff")) engine.cutoffMode = cbf::CutoffMode::Physics;
+	else engine.cutoffMode = cbf::CutoffMode::LoopStart;
+}
+
 $on_mod(Loaded) {
 	auto& manager = cbf::Manager::get();
+
+#ifdef CBF_TRACE
+	// this is the game thread, the input thread names itself
+	CBF_TRACE_THREAD("game");
+	const auto tracePath = Mod::get()->getSaveDir() / "trace.json";
+	std::string traceError;
+	if (cbf::trace::Tracer::get().start(tracePath.string().c_str(), traceError)) log::info("Tracing to {}", tracePath.string());
+	else log::warn("Tracing failed to start: {}", traceError);
+#endif
+
 	toggleMod(Mod::get()->getSettingValue<bool>("soft-toggle"));
 	listenForSettingChanges("soft-toggle", toggleMod);
 
-	manager.lateCutoff = Mod::get()->getSettingValue<bool>("late-cutoff");
-	listenForSettingChanges("late-cutoff", +[](bool enable) {
-		cbf::Manager::get().lateCutoff = enable;
+	updateCutoffMode();
+	listenForSettingChanges("late-cutoff", +[](bool) { updateCutoffMode(); });
+	listenForSettingChanges("adaptive-cutoff", +[](bool) { updateCutoffMode(); });
+
+	manager.engine.maxSubSteps = Mod::get()->getSettingValue<int64_t>("max-substeps");
+	listenForSettingChanges("max-substeps", +[](int64_t steps) {
+		cbf::Manager::get().engine.maxSubSteps = steps;
+	});
+
+	manager.engine.maxExtraPasses = Mod::get()->getSettingValue<int64_t>("max-extra-passes");
+	listenForSettingChanges("max-extra-passes", +[](int64_t passes) {
+		cbf::Manager::get().engine.maxExtraPasses = passes;
 	});
 
+	setDebugLog(Mod::get()->getSettingValue<bool>("debug-log"));
+	listenForSettingChanges("debug-log", setDebugLog);
+
+	setRecording(Mod::get()->getSettingValue<bool>("record-sessions"));
+	listenForSettingChanges("record-sessions", setRecording);
+
+	setInputExport(Mod::get()->getSettingValue<bool>("export-inputs"));
+	listenForSettingChanges("export-inputs", setInputExport);
+
+	updateStepCost();
+	listenForSettingChanges("substep-profiler", +[](bool) { updateStepCost(); });
+	listenForSettingChanges("substep-overlay", +[](bool) { updateStepCost(); });
+
 	manager.actualDelta = Mod::get()->getSettingValue<bool>("actual-delta");
 	listenForSettingChanges("actual-delta", +[](bool enable) {
 		cbf::Manager::get().actualDelta = enable;
 	});
 }
+
+$on_mod(Unloaded) {
+	cbf::Manager::get().logFlusher.stop();
+
+#ifdef CBF_TRACE
+	// the trace is only valid json once it is finished, which otherwise waits for the tracer to reach maxEvents
+	cbf::trace::Tracer::get().stop();
+#endif
+}
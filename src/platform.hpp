@@ -1,71 +1,45 @@
 #pragma once
 
-#include <stdint.h>
 #include <Geode/Geode.hpp>
-#include <queue>
 
-namespace cbf {
-
-using TimestampType = int64_t;
-
-TimestampType getCurrentTime();
-
-enum class Player : bool {
-    Player1 = 0,
-    Player2 = 1,
-};
-
-enum InputState : bool {
-    Press = 0,
-    Release = 1
-};
+#include "deferred_log.hpp"
+#include "engine.hpp"
+#include "input_export.hpp"
+#include "input_thread.hpp"
+#include "keybinds.hpp"
+#include "recording.hpp"
+#include "step_cost.hpp"
 
-struct Input {
-    TimestampType time = 0;
-    PlayerButton type = PlayerButton::Jump;
-    InputState state = InputState::Press;
-    Player player = Player::Player1;
-};
-
-struct Step {
-    // input that caused this new physics step
-    Input input;
-    double deltaFactor = 1.0;
-    bool endStep = true;
-};
+namespace cbf {
 
 struct Manager {
-    std::queue<Input> inputQueue;
-
-    std::mutex inputQueueLock;
-    std::mutex keybindsLock;
+    Engine engine;
 
-    bool enableRightClick = false;
+    Published<KeybindTable> keybinds; // read by the input thread on every key
+    LatencyHistogram inputLatency; // input thread woke up -> its inputs are queued, windows only
 
-    std::queue<Input> inputQueueCopy;
-    std::queue<Step> stepQueue;
+    // debug messages from the physics hooks and the input thread, formatted by flushDeferredLogs
+    DeferredLog gameLog;
+    DeferredLog inputLog;
+    LogFlusher logFlusher; // only while the debug-log setting is on
 
-    Input nextInput;
+    Recorder recorder; // attached to engine while the record-sessions setting is on
+    InputExportWriter inputExport; // written by updateDeltaFactorAndInput while the export-inputs setting is on
+    StepCost stepCost; // PlayerObject::update's own cost, while the profiler or its overlay is on
 
-    TimestampType lastFrameTime;
-    TimestampType lastPhysicsFrameTime;
-    TimestampType currentFrameTime;
-
-    bool firstFrame = true;
-    bool skipUpdate = true;
     bool enableInput = false;
-    bool lateCutoff = false;
 
     float p1CollisionDelta;
     float p2CollisionDelta;
     bool actualDelta = false;
 
-    bool softToggle = false; // cant just disable all hooks bc thatll cause a memory leak with inputQueue, may improve this in the future
+    bool softToggle = false; // cant just disable all hooks bc inputQueue would fill up and start dropping inputs, may improve this in the future
 
     cocos2d::CCPoint p1Pos = { 0.f, 0.f };
     cocos2d::CCPoint p2Pos = { 0.f, 0.f };
 
-    float rotationDelta;
+    float p1RotationDelta;
+    float p2RotationDelta;
 
     bool midStep = false;
 
@@ -74,9 +48,14 @@ struct Manager {
         return instance;
     }
 
+    // must only be called from a single input thread
     inline void addInput(Input ipt) {
-		std::lock_guard lock(inputQueueLock);
-        inputQueue.emplace(std::move(ipt));
+        engine.addInput(ipt);
+    }
+
+    // for inputs timestamped by the platform, the timestamp is checked against when it was received
+    inline void addInput(Input ipt, ClockSource source) {
+        engine.addInput(ipt, source, getCurrentTime());
     }
 private:
     Manager() = default;
@@ -0,0 +1,116 @@
+#pragma once
+
+// decoding of windows RAWINPUT packets, kept free of windows.h and Geode so it can be
+// benchmarked and fuzzed anywhere. windows.cpp checks the layout against the real structs
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <span>
+
+#include "engine.hpp"
+
+namespace cbf {
+
+namespace rawinput {
+
+// RAWINPUTHEADER is { DWORD dwType; DWORD dwSize; HANDLE hDevice; WPARAM wParam; }
+constexpr size_t headerSize = 8 + 2 * sizeof(void*);
+constexpr size_t typeOffset = 0;
+constexpr size_t sizeOffset = 4;
+
+constexpr uint32_t typeMouse = 0; // RIM_TYPEMOUSE
+constexpr uint32_t typeKeyboard = 1; // RIM_TYPEKEYBOARD
+
+// RAWKEYBOARD is { USHORT MakeCode; USHORT Flags; USHORT Reserved; USHORT VKey; UINT Message; ULONG ExtraInformation; }
+constexpr size_t keyboardFlagsOffset = headerSize + 2;
+constexpr size_t keyboardVKeyOffset = headerSize + 6;
+constexpr uint16_t keyBreak = 0x01; // RI_KEY_BREAK
+
+// RAWMOUSE is { USHORT usFlags; union { ULONG ulButtons; struct { USHORT usButtonFlags; USHORT usButtonData; }; }; ... }
+constexpr size_t mouseButtonFlagsOffset = headerSize + 4;
+constexpr uint16_t mouseButton1Down = 0x0001; // RI_MOUSE_BUTTON_1_DOWN
+constexpr uint16_t mouseButton1Up = 0x0002;
+constexpr uint16_t mouseButton2Down = 0x0004;
+constexpr uint16_t mouseButton2Up = 0x0008;
+
+// packets in a GetRawInputBuffer block start on 8 byte boundaries (NEXTRAWINPUTBLOCK)
+constexpr size_t blockAlignment = 8;
+
+}
+
+enum class RawInputKind : uint8_t {
+    Other, // anything that isnt a key or a mouse button 1/2 transition, including truncated packets
+    Keyboard,
+    Mouse
+};
+
+struct RawInputEvent {
+    RawInputKind kind = RawInputKind::Other;
+    InputState state = InputState::Press;
+    uint16_t vkey = 0; // keyboard only
+    Player player = Player::Player1; // mouse only, left button is p1 and right button p2
+};
+
+template <typename T>
+T readRaw(std::span<const std::byte> bytes, size_t offset) {
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+// one RAWINPUT packet. never reads outside of packet, whatever it contains
+inline RawInputEvent decodeRawInput(std::span<const std::byte> packet) {
+    RawInputEvent event;
+    if (packet.size() < rawinput::headerSize) return event;
+
+    switch (readRaw<uint32_t>(packet, rawinput::typeOffset)) {
+    case rawinput::typeKeyboard: {
+        if (packet.size() < rawinput::keyboardVKeyOffset + 2) return event;
+        event.kind = RawInputKind::Keyboard;
+        event.vkey = readRaw<uint16_t>(packet, rawinput::keyboardVKeyOffset);
+        event.state = readRaw<uint16_t>(packet, rawinput::keyboardFlagsOffset) & rawinput::keyBreak ? InputState::Release : InputState::Press;
+        return event;
+    }
+    case rawinput::typeMouse: {
+        if (packet.size() < rawinput::mouseButtonFlagsOffset + 2) return event;
+        const uint16_t flags = readRaw<uint16_t>(packet, rawinput::mouseButtonFlagsOffset);
+
+        // one transition per packet, left button first
+        event.kind = RawInputKind::Mouse;
+        if (flags & rawinput::mouseButton1Down) event.state = InputState::Press;
+        else if (flags & rawinput::mouseButton1Up) event.state = InputState::Release;
+        else {
+            event.player = Player::Player2;
+            if (flags & rawinput::mouseButton2Down) event.state = InputState::Press;
+            else if (flags & rawinput::mouseButton2Up) event.state = InputState::Release;
+            else event.kind = RawInputKind::Other;
+        }
+        return event;
+    }
+    default:
+        return event;
+    }
+}
+
+// walks the count packets GetRawInputBuffer wrote into block, stopping early at a malformed one
+template <typename F>
+size_t forEachRawInput(std::span<const std::byte> block, size_t count, F&& fn) {
+    size_t offset = 0;
+    size_t decoded = 0;
+    for (; decoded < count; decoded++) {
+        if (block.size() - offset < rawinput::headerSize) break;
+
+        const uint32_t size = readRaw<uint32_t>(block, offset + rawinput::sizeOffset);
+        if (size < rawinput::headerSize || size > block.size() - offset) break;
+
+        fn(decodeRawInput(block.subspan(offset, size)));
+
+        const size_t aligned = (size + rawinput::blockAlignment - 1) & ~(rawinput::blockAlignment - 1);
+        offset = std::min(offset + aligned, block.size());
+    }
+    return decoded;
+}
+
+}
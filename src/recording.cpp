@@ -0,0 +1,355 @@
+#include "recording.hpp"
+
+#include <cstring>
+
+namespace cbf {
+
+using namespace recording;
+
+namespace {
+
+// longest a single record can encode to: type, time, then a frame's fields
+constexpr size_t maxRecordSize = 64;
+
+uint64_t zigzag(int64_t value) {
+	return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+	return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+struct Writer {
+	uint8_t* pos;
+
+	void byte(uint8_t value) { *pos++ = value; }
+
+	void varint(uint64_t value) {
+		while (value >= 0x80) {
+			*pos++ = static_cast<uint8_t>(value) | 0x80;
+			value >>= 7;
+		}
+		*pos++ = static_cast<uint8_t>(value);
+	}
+
+	void duration(Duration value) { varint(zigzag(value.count())); }
+
+	void float32(float value) {
+		std::memcpy(pos, &value, sizeof(value));
+		pos += sizeof(value);
+	}
+};
+
+// every read is bounds checked, a damaged chunk just fails to decode
+struct Reader {
+	const uint8_t* pos;
+	const uint8_t* end;
+	bool ok = true;
+
+	uint8_t byte() {
+		if (pos == end) {
+			ok = false;
+			return 0;
+		}
+		return *pos++;
+	}
+
+	uint64_t varint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			const uint8_t next = byte();
+			value |= static_cast<uint64_t>(next & 0x7f) << shift;
+			if (!(next & 0x80)) return value;
+		}
+		ok = false;
+		return 0;
+	}
+
+	Duration duration() { return Duration(unzigzag(varint())); }
+
+	float float32() {
+		float value = 0.0f;
+		if (end - pos < static_cast<ptrdiff_t>(sizeof(value))) {
+			ok = false;
+			return value;
+		}
+		std::memcpy(&value, pos, sizeof(value));
+		pos += sizeof(value);
+		return value;
+	}
+};
+
+}
+
+bool Recorder::start(const char* path, std::string& error) {
+	if (running()) {
+		error = "already recording";
+		return false;
+	}
+
+	file = std::fopen(path, "wb");
+	if (!file) {
+		error = std::string("cant create ") + path;
+		return false;
+	}
+
+	FileHeader header {};
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.chunkSize = chunkSize;
+	std::fwrite(&header, sizeof(header), 1, file);
+	written.store(sizeof(header), std::memory_order_relaxed);
+
+	// allocated once and kept, a thread that raced with stop() may still push into its ring
+	for (auto& stream : streams) {
+		if (!stream) stream = std::make_unique<Stream>();
+		stream->ring.clear();
+		stream->used = 0;
+		stream->records = 0;
+	}
+
+	active.store(true, std::memory_order_release);
+	writer = std::thread([this] {
+		while (running()) {
+			std::this_thread::sleep_for(writeInterval);
+			drain();
+		}
+	});
+	return true;
+}
+
+void Recorder::stop() {
+	if (!running()) return;
+	active.store(false, std::memory_order_release);
+	writer.join();
+
+	drain();
+	for (size_t i = 0; i < streams.size(); i++) {
+		if (streams[i]->records) writeChunk(static_cast<uint8_t>(i));
+	}
+	std::fclose(file);
+	file = nullptr;
+}
+
+uint64_t Recorder::dropped() const {
+	uint64_t count = 0;
+	for (const auto& stream : streams) {
+		if (stream) count += stream->ring.overflows();
+	}
+	return count;
+}
+
+void Recorder::push(size_t stream, const RecordedEvent& event) {
+	if (running()) streams[stream]->ring.push(event);
+}
+
+void Recorder::loop(TimestampType now, CutoffMode mode) {
+	lastGameTime = now;
+	push(gameStream, RecordedEvent { .time = now, .type = RecordType::Loop, .cutoffMode = mode, .frame = {}, .input = {} });
+}
+
+void Recorder::frame(TimestampType now, CutoffMode mode, const RecordedFrame& frame) {
+	lastGameTime = now;
+	RecordedEvent event { .time = now, .type = RecordType::Frame, .cutoffMode = mode, .frame = frame, .input = {} };
+	event.frame.game = game;
+	push(gameStream, event);
+}
+
+void Recorder::reset() {
+	push(gameStream, RecordedEvent { .time = lastGameTime, .type = RecordType::Reset, .frame = {}, .input = {} });
+}
+
+void Recorder::suspend() {
+	push(gameStream, RecordedEvent { .time = lastGameTime, .type = RecordType::Suspend, .frame = {}, .input = {} });
+}
+
+void Recorder::input(size_t lane, const Input& input, TimestampType eventTime, TimestampType receiveTime) {
+	push(1 + lane, RecordedEvent { .time = receiveTime, .type = RecordType::Input, .frame = {}, .input = { input, eventTime } });
+}
+
+void Recorder::drain() {
+	for (size_t i = 0; i < streams.size(); i++) {
+		auto& ring = streams[i]->ring;
+		ring.takeBatch(TimestampType::max());
+		ring.forEachInBatch([&](const RecordedEvent& event) { encode(static_cast<uint8_t>(i), event); });
+		ring.release(ring.batchEnd());
+	}
+}
+
+void Recorder::encode(uint8_t index, const RecordedEvent& event) {
+	Stream& stream = *streams[index];
+	if (stream.used + maxRecordSize > stream.payload.size()) writeChunk(index);
+	if (!stream.records) stream.baseTime = stream.lastTime = event.time;
+
+	Writer out { stream.payload.data() + stream.used };
+	out.byte(static_cast<uint8_t>(event.type));
+	out.duration(event.time - stream.lastTime);
+
+	switch (event.type) {
+	case RecordType::Loop:
+		out.byte(static_cast<uint8_t>(event.cutoffMode));
+		break;
+	case RecordType::Frame: {
+		const RecordedFrame& frame = event.frame;
+		out.byte(frame.dualMode | static_cast<uint8_t>(event.cutoffMode) << 1 | frame.game.actualDelta << 3);
+		out.duration(frame.currentFrameTime - event.time);
+		out.duration(frame.lastFrameTime - frame.currentFrameTime);
+		out.varint(static_cast<uint64_t>(std::max(frame.stepCount, 0)));
+		out.varint(static_cast<uint64_t>(std::max(frame.maxSubSteps, 0)));
+		out.varint(static_cast<uint64_t>(std::max(frame.maxExtraPasses, 0)));
+		out.float32(frame.game.modifiedDelta);
+		out.float32(frame.game.timewarp);
+		break;
+	}
+	case RecordType::Input: {
+		const Input& input = event.input.input;
+		out.duration(input.time - event.time);
+		out.duration(event.input.eventTime - event.time);
+		out.byte(static_cast<uint8_t>(input.type) | static_cast<uint8_t>(input.state) << 2 | static_cast<uint8_t>(input.player) << 3);
+		break;
+	}
+	default:
+		break;
+	}
+
+	stream.used = out.pos - stream.payload.data();
+	stream.lastTime = event.time;
+	stream.records++;
+}
+
+void Recorder::writeChunk(uint8_t index) {
+	Stream& stream = *streams[index];
+
+	ChunkHeader header {};
+	header.baseTime = stream.baseTime.time_since_epoch().count();
+	header.payloadSize = static_cast<uint32_t>(stream.used);
+	header.recordCount = stream.records;
+	header.stream = index;
+
+	// zero padded to the full chunk size so every chunk starts at a fixed offset
+	std::fill(stream.payload.begin() + stream.used, stream.payload.end(), 0);
+	std::fwrite(&header, sizeof(header), 1, file);
+	std::fwrite(stream.payload.data(), stream.payload.size(), 1, file);
+	std::fflush(file);
+
+	written.fetch_add(chunkSize, std::memory_order_relaxed);
+	stream.used = 0;
+	stream.records = 0;
+}
+
+RecordingReader::RecordingReader(std::span<const uint8_t> data) : data(data) {
+	FileHeader header;
+	if (data.size() < sizeof(header)) {
+		lastError = "too short for a recording";
+		return;
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::memcmp(header.magic, magic, sizeof(magic))) lastError = "not a recording";
+	else if (header.version != version) lastError = "recording version " + std::to_string(header.version) + ", this reads " + std::to_string(version);
+	else if (header.chunkSize != chunkSize) lastError = "unexpected chunk size " + std::to_string(header.chunkSize);
+	if (!lastError.empty()) return;
+
+	chunks = (data.size() - sizeof(header)) / chunkSize;
+	if ((data.size() - sizeof(header)) % chunkSize) damaged++; // the writer was cut off mid chunk
+}
+
+bool RecordingReader::nextChunk(size_t stream, Cursor& cursor) {
+	while (cursor.chunk < chunks) {
+		const uint8_t* chunk = data.data() + sizeof(FileHeader) + cursor.chunk * chunkSize;
+		cursor.chunk++;
+
+		ChunkHeader header;
+		std::memcpy(&header, chunk, sizeof(header));
+		if (header.stream != stream) continue;
+		if (header.payloadSize > payloadCapacity) {
+			damaged++;
+			continue;
+		}
+
+		cursor.pos = chunk + sizeof(header);
+		cursor.end = cursor.pos + header.payloadSize;
+		cursor.recordsLeft = header.recordCount;
+		cursor.lastTime = TimestampType(Duration(header.baseTime));
+		return true;
+	}
+	return false;
+}
+
+bool RecordingReader::next(size_t stream, RecordedEvent& event) {
+	if (!valid() || stream >= cursors.size()) return false;
+	Cursor& cursor = cursors[stream];
+
+	while (true) {
+		if (cursor.done) return false;
+		if (!cursor.recordsLeft && !nextChunk(stream, cursor)) {
+			cursor.done = true;
+			return false;
+		}
+		if (!cursor.recordsLeft) continue; // an empty chunk
+
+		if (decode(static_cast<uint8_t>(stream), cursor, event)) {
+			cursor.recordsLeft--;
+			return true;
+		}
+
+		// whatever is left of the chunk cant be trusted
+		damaged++;
+		cursor.recordsLeft = 0;
+	}
+}
+
+bool RecordingReader::decode(uint8_t stream, Cursor& cursor, RecordedEvent& event) {
+	Reader in { cursor.pos, cursor.end };
+
+	event = {};
+	event.stream = stream;
+	const uint8_t type = in.byte();
+	if (type >= static_cast<uint8_t>(RecordType::Count)) return false;
+	event.type = static_cast<RecordType>(type);
+	event.time = cursor.lastTime + in.duration();
+
+	switch (event.type) {
+	case RecordType::Loop: {
+		const uint8_t mode = in.byte();
+		if (mode >= static_cast<uint8_t>(CutoffMode::Count)) return false;
+		event.cutoffMode = static_cast<CutoffMode>(mode);
+		break;
+	}
+	case RecordType::Frame: {
+		RecordedFrame& frame = event.frame;
+		const uint8_t flags = in.byte();
+		if ((flags >> 1 & 3) >= static_cast<uint8_t>(CutoffMode::Count)) return false;
+		frame.dualMode = flags & 1;
+		event.cutoffMode = static_cast<CutoffMode>(flags >> 1 & 3);
+		frame.game.actualDelta = flags >> 3 & 1;
+		frame.currentFrameTime = event.time + in.duration();
+		frame.lastFrameTime = frame.currentFrameTime + in.duration();
+		frame.stepCount = static_cast<int>(in.varint());
+		frame.maxSubSteps = static_cast<int>(in.varint());
+		frame.maxExtraPasses = static_cast<int>(in.varint());
+		frame.game.modifiedDelta = in.float32();
+		frame.game.timewarp = in.float32();
+		break;
+	}
+	case RecordType::Input: {
+		Input& input = event.input.input;
+		input.time = event.time + in.duration();
+		event.input.eventTime = event.time + in.duration();
+		const uint8_t packed = in.byte();
+		if ((packed & 3) < 1) return false;
+		input.type = static_cast<PlayerButton>(packed & 3);
+		input.state = static_cast<InputState>(packed >> 2 & 1);
+		input.player = static_cast<Player>(packed >> 3 & 1);
+		break;
+	}
+	default:
+		break;
+	}
+
+	if (!in.ok) return false;
+	cursor.pos = in.pos;
+	cursor.lastTime = event.time;
+	return true;
+}
+
+}
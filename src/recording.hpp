@@ -0,0 +1,196 @@
+#pragma once
+
+// session recordings: everything the engine was fed, so a real session can be replayed through the
+// scheduler offline (tools/replay.cpp). the engine hands events to a Recorder from the threads that
+// produce them, a background thread encodes and appends them to the file, nothing on the game or
+// input threads ever touches the disk
+//
+// file layout, little endian:
+//   FileHeader, then fixed size chunks of chunkSize bytes, each a ChunkHeader and its payload
+//   every chunk holds records of one stream: stream 0 is the game thread, stream 1 + lane each input lane
+//   chunks of a stream are in order, streams are interleaved however they filled up
+//   a record is a type byte, the zigzag varint of its time minus the previous record's in the chunk
+//   (the chunk's baseTime for the first), then its fields, see Recorder::encode
+// chunks are independent and fixed size, so the file can be mapped and read from any chunk on
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace cbf {
+
+namespace recording {
+
+constexpr char magic[8] = { 'C', 'B', 'F', 'R', 'E', 'C', 0, 0 };
+constexpr uint32_t version = 1;
+constexpr size_t chunkSize = 4096;
+constexpr size_t streamCount = 1 + inputLanes;
+constexpr size_t gameStream = 0;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkSize;
+};
+static_assert(sizeof(FileHeader) == 16);
+
+struct ChunkHeader {
+    int64_t baseTime; // frame clock ns
+    uint32_t payloadSize;
+    uint16_t recordCount;
+    uint8_t stream;
+    uint8_t reserved;
+};
+static_assert(sizeof(ChunkHeader) == 16);
+
+constexpr size_t payloadCapacity = chunkSize - sizeof(ChunkHeader);
+
+enum class RecordType : uint8_t {
+    Loop, // beginLoop
+    Frame, // beginFrame
+    Reset,
+    Suspend,
+    Input, // addInput
+    Count
+};
+
+}
+
+// what the game passed to getModifiedDelta's caller, recorded with the frame it led to
+struct GameInfo {
+    float modifiedDelta = 0.0f;
+    float timewarp = 1.0f;
+    bool actualDelta = false;
+};
+
+struct RecordedFrame {
+    TimestampType currentFrameTime {}; // what beginFrame decided, a replay can check it gets the same
+    TimestampType lastFrameTime {};
+    int stepCount = 0;
+    bool dualMode = false;
+    int maxSubSteps = 0;
+    int maxExtraPasses = 0;
+    GameInfo game;
+};
+
+struct RecordedInput {
+    Input input; // as it was queued, its time already aligned
+    TimestampType eventTime {}; // the platform's own timestamp before alignment
+};
+
+// one record of any stream
+struct RecordedEvent {
+    TimestampType time {}; // beginLoop/beginFrame's now, an input's receive time, reset/suspend the last game time
+    recording::RecordType type = recording::RecordType::Loop;
+    uint8_t stream = 0;
+    CutoffMode cutoffMode = CutoffMode::LoopStart; // Loop and Frame
+    RecordedFrame frame; // Frame
+    RecordedInput input; // Input
+};
+
+class Recorder {
+public:
+    static constexpr size_t ringCapacity = 4096;
+    // how often the writer drains the rings, a ring holds far more than this many ms of inputs
+    static constexpr auto writeInterval = std::chrono::milliseconds(10);
+
+    Recorder() = default;
+    ~Recorder() { stop(); }
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // creates path and starts the writer, false (with error set) if it cant be written
+    bool start(const char* path, std::string& error);
+    // writes out everything recorded so far and closes the file, safe to call when not started
+    // the engine must not be recording into this anymore
+    void stop();
+    bool running() const { return active.load(std::memory_order_relaxed); }
+
+    // game thread
+    void setGameInfo(const GameInfo& info) { game = info; }
+    void loop(TimestampType now, CutoffMode mode);
+    void frame(TimestampType now, CutoffMode mode, const RecordedFrame& frame);
+    void reset();
+    void suspend();
+
+    // the lane's own thread
+    void input(size_t lane, const Input& input, TimestampType eventTime, TimestampType receiveTime);
+
+    // records lost to a full ring
+    uint64_t dropped() const;
+    uint64_t bytesWritten() const { return written.load(std::memory_order_relaxed); }
+
+private:
+    struct Stream {
+        SpscRing<RecordedEvent, ringCapacity> ring;
+        // writer only
+        std::array<uint8_t, recording::payloadCapacity> payload;
+        size_t used = 0;
+        uint16_t records = 0;
+        TimestampType baseTime {};
+        TimestampType lastTime {};
+    };
+
+    void push(size_t stream, const RecordedEvent& event);
+    void drain();
+    void encode(uint8_t stream, const RecordedEvent& event);
+    void writeChunk(uint8_t stream);
+
+    std::array<std::unique_ptr<Stream>, recording::streamCount> streams;
+    std::atomic<bool> active = false;
+    std::thread writer;
+    FILE* file = nullptr;
+    std::atomic<uint64_t> written = 0;
+
+    // game thread only
+    GameInfo game;
+    TimestampType lastGameTime {};
+};
+
+// decodes a recording held in memory, eg. mapped. every stream is read in order on its own,
+// merging them back into one timeline is up to the caller
+class RecordingReader {
+public:
+    // data has to outlive the reader
+    explicit RecordingReader(std::span<const uint8_t> data);
+
+    // false if the header is wrong, error() says why
+    bool valid() const { return lastError.empty(); }
+    const std::string& error() const { return lastError; }
+    size_t chunkCount() const { return chunks; }
+    // chunks that were cut off or didnt decode, the rest of such a chunk is skipped
+    size_t damagedChunks() const { return damaged; }
+
+    // next record of a stream, false once it has no more
+    bool next(size_t stream, RecordedEvent& event);
+
+private:
+    struct Cursor {
+        size_t chunk = 0; // next chunk to look at
+        const uint8_t* pos = nullptr; // in the current chunk's payload
+        const uint8_t* end = nullptr;
+        size_t recordsLeft = 0;
+        TimestampType lastTime {};
+        bool done = false;
+    };
+
+    bool nextChunk(size_t stream, Cursor& cursor);
+    bool decode(uint8_t stream, Cursor& cursor, RecordedEvent& event);
+
+    std::span<const uint8_t> data;
+    size_t chunks = 0;
+    size_t damaged = 0;
+    std::string lastError;
+    std::array<Cursor, recording::streamCount> cursors;
+};
+
+}
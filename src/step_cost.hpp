@@ -0,0 +1,215 @@
+#pragma once
+
+// what sub-stepping costs on the game thread. the PlayerObject::update hook times every call it makes
+// (the player update, checkCollisions, updateRotation, newResetCollisionLog) with the cpu's tick counter
+// and files it under the passes the game runs anyway (a step's end) or the extra ones CBF inserts for
+// inputs. totals are kept per frame and only go into fixed bucket histograms once the frame is over,
+// so a sample is a counter read and two adds
+
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iterator>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "engine.hpp"
+
+namespace cbf {
+
+// the cpu's timestamp counter where there is one (rdtsc, cntvct_el0), both tick at a fixed rate.
+// StepCost works out the rate against getCurrentTime
+inline uint64_t readTicks() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return static_cast<uint64_t>(getCurrentTime().time_since_epoch().count());
+#endif
+}
+
+enum class CostPhase : uint8_t {
+    Update, // PlayerObject::update, also what counts a pass
+    Collisions,
+    Rotation,
+    ResetCollisionLog,
+    Count
+};
+
+inline constexpr const char* costPhaseNames[] = { "update", "collisions", "rotation", "collision log reset" };
+static_assert(std::size(costPhaseNames) == size_t(CostPhase::Count));
+
+// histogram of one value per frame. Log2: bucket 0 is 0 and bucket i is [2^(i-1), 2^i), otherwise
+// bucket i is exactly i. the last bucket takes everything past it. single threaded
+template <size_t Buckets, bool Log2>
+class FrameHistogram {
+public:
+    static constexpr size_t bucketCount = Buckets;
+
+    void record(uint64_t value) {
+        const size_t bucket = std::min<size_t>(Log2 ? std::bit_width(value) : value, bucketCount - 1);
+        buckets[bucket]++;
+        frames++;
+        total += value;
+        maxValue = std::max(maxValue, value);
+    }
+
+    void clear() { *this = {}; }
+
+    uint64_t count() const { return frames; }
+    uint64_t sum() const { return total; }
+    uint64_t max() const { return maxValue; }
+    double mean() const { return frames ? static_cast<double>(total) / frames : 0.0; }
+
+    // upper edge of the bucket the fraction-th frame is in, never more than max()
+    uint64_t percentile(double fraction) const {
+        if (!frames) return 0;
+
+        const uint64_t rank = static_cast<uint64_t>(std::clamp(fraction, 0.0, 1.0) * (frames - 1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i + 1 < bucketCount; i++) {
+            seen += buckets[i];
+            if (seen > rank) return std::min(maxValue, Log2 ? (i ? (uint64_t(1) << i) - 1 : 0) : i);
+        }
+        return maxValue;
+    }
+
+private:
+    std::array<uint64_t, Buckets> buckets {};
+    uint64_t frames = 0;
+    uint64_t total = 0;
+    uint64_t maxValue = 0;
+};
+
+// game thread only
+class StepCost {
+public:
+    using TickHistogram = FrameHistogram<48, true>;
+    using PassHistogram = FrameHistogram<128, false>;
+
+    // what the overlay shows, everything since the last takeWindow()
+    struct Window {
+        uint64_t frames = 0;
+        uint64_t ticks[2] {}; // regular, extra
+        uint64_t passes[2] {};
+        uint64_t maxExtraTicks = 0; // worst frame
+    };
+
+    void setEnabled(bool enable) {
+        if (enable && !enabled) clear();
+        enabled = enable;
+    }
+    bool isEnabled() const { return enabled; }
+
+    // start of the first sample, 0 when disabled so the hooks dont have to check
+    uint64_t start() const { return enabled ? readTicks() : 0; }
+
+    // files everything since started (start() or the last lap) under phase, and returns when that was
+    // so back to back calls are timed with one counter read each. extra: the pass is one CBF inserted
+    uint64_t lap(CostPhase phase, bool extra, uint64_t started) {
+        if (!started) return 0;
+        const uint64_t now = readTicks();
+        const uint64_t ticks = now - started;
+
+        phaseTicks[extra][static_cast<size_t>(phase)] += ticks;
+        frame.ticks[extra] += ticks;
+        frame.passes[extra] += phase == CostPhase::Update;
+        return now;
+    }
+
+    // a physics frame is over, beginFrame. frames that never reached the player update arent counted
+    void endFrame() {
+        if (!enabled) return;
+
+        // the counter rate, over everything measured so far
+        const TimestampType now = getCurrentTime();
+        if (calibrationStart == TimestampType {}) {
+            calibrationStart = now;
+            calibrationTicks = readTicks();
+        }
+        else {
+            calibrationEnd = now;
+            calibrationEndTicks = readTicks();
+        }
+
+        if (!frame.passes[0] && !frame.passes[1]) return;
+
+        regularTicks.record(frame.ticks[0]);
+        extraTicks.record(frame.ticks[1]);
+        passes.record(frame.passes[0] + frame.passes[1]);
+        extraPasses.record(frame.passes[1]);
+
+        window.frames++;
+        for (size_t i = 0; i < 2; i++) {
+            window.ticks[i] += frame.ticks[i];
+            window.passes[i] += frame.passes[i];
+        }
+        window.maxExtraTicks = std::max(window.maxExtraTicks, frame.ticks[1]);
+
+        frame = {};
+    }
+
+    // everything since the last call
+    Window takeWindow() {
+        const Window taken = window;
+        window = {};
+        return taken;
+    }
+
+    // a new level
+    void clear() {
+        frame = {};
+        window = {};
+        phaseTicks = {};
+        regularTicks.clear();
+        extraTicks.clear();
+        passes.clear();
+        extraPasses.clear();
+        calibrationStart = calibrationEnd = {};
+        calibrationTicks = calibrationEndTicks = 0;
+    }
+
+    // counter ticks in ns, 1 until a few frames have been measured
+    double nsPerTick() const {
+        const int64_t ns = (calibrationEnd - calibrationStart).count();
+        const uint64_t ticks = calibrationEndTicks - calibrationTicks;
+        if (calibrationEnd == TimestampType {} || ns < 1'000'000 || !ticks) return 1.0;
+        return static_cast<double>(ns) / ticks;
+    }
+
+    double micros(double ticks) const { return ticks * nsPerTick() / 1000.0; }
+
+    // per frame
+    TickHistogram regularTicks;
+    TickHistogram extraTicks;
+    PassHistogram passes; // player update passes, both players in dual mode
+    PassHistogram extraPasses;
+
+    // whole level, regular then extra
+    std::array<std::array<uint64_t, size_t(CostPhase::Count)>, 2> phaseTicks {};
+
+private:
+    struct Frame {
+        uint64_t ticks[2] {};
+        uint64_t passes[2] {};
+    };
+
+    bool enabled = false;
+    Frame frame;
+    Window window;
+
+    TimestampType calibrationStart {};
+    TimestampType calibrationEnd {};
+    uint64_t calibrationTicks = 0;
+    uint64_t calibrationEndTicks = 0;
+};
+
+}
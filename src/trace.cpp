@@ -0,0 +1,118 @@
+#include "trace.hpp"
+
+namespace cbf::trace {
+
+// how often the flusher empties the rings, well under the time it takes one to fill up
+constexpr auto flushInterval = std::chrono::milliseconds(50);
+
+bool Tracer::start(const char* path, std::string& error) {
+	if (running()) {
+		error = "already tracing";
+		return false;
+	}
+	// a trace that hit maxEvents finished itself, its flusher only has to be joined
+	if (flusher.joinable()) flusher.join();
+
+	file = std::fopen(path, "w");
+	if (!file) {
+		error = std::string("cant open ") + path;
+		return false;
+	}
+
+	// anything recorded while the tracer was stopped is dropped, its times would be before origin
+	for (size_t i = 0; i < ringCount.load(std::memory_order_acquire); i++) rings[i]->ring.clear();
+
+	origin = getCurrentTime();
+	firstEvent = true;
+	written = 0;
+	std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+
+	active.store(true, std::memory_order_release);
+	flusher = std::thread([this] {
+		while (running()) {
+			std::this_thread::sleep_for(flushInterval);
+			if (!flush()) {
+				active.store(false, std::memory_order_release);
+				finish();
+			}
+		}
+	});
+	return true;
+}
+
+void Tracer::stop() {
+	if (!flusher.joinable()) return;
+	active.store(false, std::memory_order_release);
+	flusher.join();
+
+	// already finished if the flusher hit maxEvents
+	if (!file) return;
+	flush();
+	finish();
+}
+
+void Tracer::finish() {
+	std::fputs("\n]}\n", file);
+	std::fclose(file);
+	file = nullptr;
+}
+
+uint64_t Tracer::dropped() const {
+	uint64_t count = 0;
+	for (size_t i = 0; i < ringCount.load(std::memory_order_acquire); i++) count += rings[i]->ring.overflows();
+	return count;
+}
+
+Tracer::ThreadRing* Tracer::registerThread() {
+	std::lock_guard lock(registerMutex);
+	const size_t index = ringCount.load(std::memory_order_relaxed);
+	if (index == maxThreads) return nullptr;
+
+	rings[index] = std::make_unique<ThreadRing>();
+	rings[index]->tid = static_cast<uint32_t>(index + 1);
+	ringCount.store(index + 1, std::memory_order_release);
+	return rings[index].get();
+}
+
+// only ever called by one thread at a time, the flusher or stop() after joining it
+bool Tracer::flush() {
+	auto separator = [&] {
+		if (!firstEvent) std::fputs(",\n", file);
+		firstEvent = false;
+	};
+
+	const size_t count = ringCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; i++) {
+		ThreadRing& thread = *rings[i];
+
+		// thread_name metadata puts the viewer's label on the thread's track
+		const char* name = thread.name.load(std::memory_order_acquire);
+		if (name && name != thread.writtenName) {
+			separator();
+			std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", thread.tid, name);
+			thread.writtenName = name;
+		}
+
+		thread.ring.takeBatch(TimestampType::max());
+		thread.ring.forEachInBatch([&](const Record& record) {
+			if (written == maxEvents) return;
+			written++;
+
+			static constexpr char phases[] = { 'B', 'E', 'i' };
+			const auto event = static_cast<size_t>(record.event);
+			const int64_t ns = (record.time - origin).count();
+
+			separator();
+			std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":1,\"tid\":%u,%s\"args\":{\"%s\":%u}}",
+				eventNames[event], phases[static_cast<size_t>(record.phase)], static_cast<long long>(ns / 1000), static_cast<long long>(ns % 1000),
+				thread.tid, record.phase == Phase::Instant ? "\"s\":\"t\"," : "", argNames[event], record.arg);
+		});
+		thread.ring.release(thread.ring.batchEnd());
+	}
+
+	// so a crash or a killed process still leaves everything up to the last flush
+	std::fflush(file);
+	return written < maxEvents;
+}
+
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+// hot path tracepoints for looking inside a single frame. every thread writes fixed size records into
+// a ring of its own, a background thread writes them out as chrome trace json (chrome://tracing, ui.perfetto.dev)
+// the CBF_TRACE_* macros only do anything when built with CBF_TRACE, otherwise they compile to nothing
+
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "engine.hpp"
+
+namespace cbf::trace {
+
+enum class Event : uint8_t {
+    ClearQueues,
+    Drain,
+    Plan,
+    SubStep,
+    ExtraPass,
+    Rotation,
+    Input,
+    Count
+};
+
+inline constexpr const char* eventNames[] = { "clear queues", "drain", "plan", "sub-step", "extra pass", "rotation", "input" };
+// what each event's argument counts, shown in the trace viewer's args
+inline constexpr const char* argNames[] = { "reset", "inputs", "steps", "player", "player", "player", "inputs" };
+static_assert(std::size(eventNames) == size_t(Event::Count) && std::size(argNames) == size_t(Event::Count));
+
+enum class Phase : uint8_t {
+    Begin,
+    End,
+    Instant
+};
+
+struct Record {
+    TimestampType time; // named time so the ring can take a batch of records like it does inputs
+    uint32_t arg;
+    Event event;
+    Phase phase;
+};
+static_assert(sizeof(Record) == 16);
+
+class Tracer {
+public:
+    static constexpr size_t ringCapacity = 16384; // ~2 seconds of a busy 1000fps frame loop
+    static constexpr size_t maxThreads = 16; // threads past this are not traced
+    // a trace left running would grow without bound, after this many events (~200MB of json) it is finished
+    // and tracing stops on its own
+    static constexpr uint64_t maxEvents = 2'000'000;
+    using Ring = SpscRing<Record, ringCapacity>;
+
+    static Tracer& get() {
+        static Tracer instance;
+        return instance;
+    }
+
+    ~Tracer() { stop(); }
+
+    // starts the flusher writing to path, false (with error set) if the file cant be opened
+    bool start(const char* path, std::string& error);
+    // flushes whatever is left and finishes the file, safe to call when not started or already capped
+    void stop();
+    bool running() const { return active.load(std::memory_order_relaxed); }
+
+    // name must outlive the tracer, a string literal
+    void nameThread(const char* name) {
+        if (ThreadRing* ring = threadRing()) ring->name.store(name, std::memory_order_release);
+    }
+
+    void record(Event event, Phase phase, uint32_t arg) {
+        if (!running()) return;
+        if (ThreadRing* ring = threadRing()) ring->ring.push(Record { getCurrentTime(), arg, event, phase });
+    }
+
+    // records lost to a full ring
+    uint64_t dropped() const;
+
+private:
+    struct ThreadRing {
+        Ring ring;
+        std::atomic<const char*> name = nullptr;
+        const char* writtenName = nullptr; // flusher only
+        uint32_t tid = 0;
+    };
+
+    Tracer() = default;
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // the calling thread's ring, registered the first time it is asked for
+    ThreadRing* threadRing() {
+        thread_local ThreadRing* ring = registerThread();
+        return ring;
+    }
+    ThreadRing* registerThread();
+
+    // false once maxEvents have been written
+    bool flush();
+    // closes the json and the file
+    void finish();
+
+    std::array<std::unique_ptr<ThreadRing>, maxThreads> rings;
+    std::atomic<size_t> ringCount = 0;
+    std::mutex registerMutex;
+
+    std::atomic<bool> active = false;
+    std::thread flusher;
+    FILE* file = nullptr;
+    TimestampType origin {};
+    bool firstEvent = true;
+    uint64_t written = 0;
+};
+
+// begin and end records around a scope, the argument is shown on the slice
+class Scope {
+public:
+    explicit Scope(Event event, uint32_t arg = 0) : event(event), arg(arg) {
+        Tracer::get().record(event, Phase::Begin, arg);
+    }
+    ~Scope() { Tracer::get().record(event, Phase::End, arg); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Event event;
+    uint32_t arg;
+};
+
+}
+
+#define CBF_TRACE_CONCAT_(a, b) a##b
+#define CBF_TRACE_CONCAT(a, b) CBF_TRACE_CONCAT_(a, b)
+
+#ifdef CBF_TRACE
+#define CBF_TRACE_SCOPE(event, ...) ::cbf::trace::Scope CBF_TRACE_CONCAT(cbfTraceScope, __LINE__)(::cbf::trace::Event::event __VA_OPT__(,) __VA_ARGS__)
+#define CBF_TRACE_BEGIN(event) ::cbf::trace::Tracer::get().record(::cbf::trace::Event::event, ::cbf::trace::Phase::Begin, 0)
+#define CBF_TRACE_END(event, arg) ::cbf::trace::Tracer::get().record(::cbf::trace::Event::event, ::cbf::trace::Phase::End, static_cast<uint32_t>(arg))
+#define CBF_TRACE_INSTANT(event, arg) ::cbf::trace::Tracer::get().record(::cbf::trace::Event::event, ::cbf::trace::Phase::Instant, static_cast<uint32_t>(arg))
+#define CBF_TRACE_THREAD(name) ::cbf::trace::Tracer::get().nameThread(name)
+#else
+// arguments are not evaluated
+#define CBF_TRACE_SCOPE(event, ...) ((void)0)
+#define CBF_TRACE_BEGIN(event) ((void)0)
+#define CBF_TRACE_END(event, arg) ((void)0)
+#define CBF_TRACE_INSTANT(event, arg) ((void)0)
+#define CBF_TRACE_THREAD(name) ((void)0)
+#endif
@@ -1,7 +1,10 @@
 #include <queue>
 #include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstddef>
 #include <limits>
-#include <mutex>
+#include <span>
 
 #include <Geode/Geode.hpp>
 #include <Geode/loader/SettingEvent.hpp>
@@ -14,121 +17,137 @@
 
 #include <geode.custom-keybinds/include/Keybinds.hpp>
 
+#include "input_thread.hpp"
 #include "platform.hpp"
+#include "rawinput.hpp"
+#include "trace.hpp"
 
 using namespace geode::prelude;
 
-enum GameAction : int {
-	p1Jump = 0,
-	p1Left = 1,
-	p1Right = 2,
-	p2Jump = 3,
-	p2Left = 4,
-	p2Right = 5
-};
+std::bitset<cbf::KeybindTable::keyCount> heldKeys; // only touched by the input thread
 
-std::unordered_set<size_t> inputBinds[6];
-std::unordered_set<USHORT> heldInputs;
+int64_t qpcFrequency() {
+	static const int64_t frequency = [] {
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		return freq.QuadPart;
+	}();
+	return frequency;
+}
 
 cbf::TimestampType cbf::getCurrentTime() {
 	LARGE_INTEGER time;
 	QueryPerformanceCounter(&time);
-	return time.QuadPart;
+	return cbf::timestampFromTicks(time.QuadPart, qpcFrequency());
 }
 
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-	LARGE_INTEGER time;
-	PlayerButton inputType;
-	cbf::InputState inputState;
-	cbf::Player player;
-	auto& manager = cbf::Manager::get();
+bool cbf::applyInputThreadPolicy(const InputThreadPolicy& policy, std::string& error) {
+	error.clear();
+	auto fail = [&](const char* what) {
+		if (!error.empty()) error += ", ";
+		error += std::string(what) + " failed: " + std::to_string(GetLastError());
+	};
 
-	QueryPerformanceCounter(&time);
-	
-	LPVOID pData;
-	switch (uMsg) {
-	case WM_INPUT: {
-		UINT dwSize;
-		GetRawInputData((HRAWINPUT)lParam, RID_INPUT, NULL, &dwSize, sizeof(RAWINPUTHEADER));
-
-		auto lpb = std::make_unique<BYTE[]>(dwSize);
-		if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, lpb.get(), &dwSize, sizeof(RAWINPUTHEADER)) != dwSize) {
-			log::debug("GetRawInputData does not return correct size");
-		}
+	// a busy polling time critical thread would starve everything else on its core
+	if (policy.highPriority) {
+		if (!SetThreadPriority(GetCurrentThread(), policy.busyPoll ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_TIME_CRITICAL)) fail("SetThreadPriority");
+	}
 
-		RAWINPUT* raw = (RAWINPUT*)lpb.get();
-		switch (raw->header.dwType) {
-		case RIM_TYPEKEYBOARD: {
-			USHORT vkey = raw->data.keyboard.VKey;
-			inputState = static_cast<cbf::InputState>(raw->data.keyboard.Flags & RI_KEY_BREAK);
+	if (policy.core >= 0) {
+		if (policy.core >= 64) error += error.empty() ? "no such core" : ", no such core";
+		else if (!SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << policy.core)) fail("SetThreadAffinityMask");
+	}
 
-			// cocos2d::enumKeyCodes corresponds directly to vkeys
-			if (heldInputs.contains(vkey)) {
-				if (!inputState) return 0;
-				else heldInputs.erase(vkey);
-			}
-			
-			bool shouldEmplace = true;
-			player = cbf::Player::Player1;
-
-			{
-				std::lock_guard lock(manager.keybindsLock);
-
-				if (inputBinds[p1Jump].contains(vkey)) inputType = PlayerButton::Jump;
-				else if (inputBinds[p1Left].contains(vkey)) inputType = PlayerButton::Left;
-				else if (inputBinds[p1Right].contains(vkey)) inputType = PlayerButton::Right;
-				else {
-					player = cbf::Player::Player2;
-					if (inputBinds[p2Jump].contains(vkey)) inputType = PlayerButton::Jump;
-					else if (inputBinds[p2Left].contains(vkey)) inputType = PlayerButton::Left;
-					else if (inputBinds[p2Right].contains(vkey)) inputType = PlayerButton::Right;
-					else shouldEmplace = false;
-				}
-				if (!inputState) heldInputs.emplace(vkey);
-			}
+	return error.empty();
+}
 
-			if (!shouldEmplace) return 0; // has to be done outside of the critical section
-			break;
-		}
-		case RIM_TYPEMOUSE: {
-			USHORT flags = raw->data.mouse.usButtonFlags;
-			bool shouldEmplace = true;
-			player = cbf::Player::Player1;
-			inputType = PlayerButton::Jump;
-
-			bool rc;
-			{
-				std::lock_guard lock(manager.keybindsLock);
-				rc = manager.enableRightClick;
-			}
+static_assert(sizeof(RAWINPUTHEADER) == cbf::rawinput::headerSize);
+static_assert(offsetof(RAWINPUT, data.keyboard.Flags) == cbf::rawinput::keyboardFlagsOffset);
+static_assert(offsetof(RAWINPUT, data.keyboard.VKey) == cbf::rawinput::keyboardVKeyOffset);
+static_assert(offsetof(RAWINPUT, data.mouse.usButtonFlags) == cbf::rawinput::mouseButtonFlagsOffset);
 
-			if (flags & RI_MOUSE_BUTTON_1_DOWN) inputState = cbf::InputState::Press;
-			else if (flags & RI_MOUSE_BUTTON_1_UP) inputState = cbf::InputState::Release;
-			else {
-				player = cbf::Player::Player2;
-				if (!rc) return 0;
-				if (flags & RI_MOUSE_BUTTON_2_DOWN) inputState = cbf::InputState::Press;
-				else if (flags & RI_MOUSE_BUTTON_2_UP) inputState = cbf::InputState::Release;
-				else return 0;
-			}
-			break;
-		}
-		default:
-			return 0;
+// input thread only, reused for every message so reading raw input never allocates
+alignas(8) std::array<std::byte, 16 * 1024> rawInputBuffer;
+
+// false if the event wasnt an input CBF cares about
+bool handleRawInput(const cbf::RawInputEvent& event, cbf::TimestampType time) {
+	auto& manager = cbf::Manager::get();
+	cbf::Input input { .time = time, .state = event.state };
+
+	switch (event.kind) {
+	case cbf::RawInputKind::Keyboard: {
+		const uint16_t vkey = event.vkey;
+		const bool press = event.state == cbf::InputState::Press;
+
+		// cocos2d::enumKeyCodes corresponds directly to vkeys
+		const bool trackHeld = vkey < heldKeys.size();
+		if (trackHeld && heldKeys[vkey]) {
+			if (press) return false;
+			else heldKeys.reset(vkey);
 		}
+		if (trackHeld && press) heldKeys.set(vkey);
+
+		const auto bind = manager.keybinds.read()->find(vkey); // a copy, the table can be swapped right after
+		if (!bind.bound) return false;
+
+		input.player = bind.player;
+		input.type = bind.button;
+		break;
+	}
+	case cbf::RawInputKind::Mouse:
+		if (event.player == cbf::Player::Player2 && !manager.keybinds.read()->rightClick) return false;
+		input.player = event.player;
+		input.type = PlayerButton::Jump;
 		break;
-	} 
 	default:
-		return DefWindowProcA(hwnd, uMsg, wParam, lParam);
+		return false;
 	}
 
-    manager.addInput(cbf::Input{ time.QuadPart, inputType, inputState, player });
+	manager.addInput(input);
+	return true;
+}
+
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+	if (uMsg != WM_INPUT) return DefWindowProcA(hwnd, uMsg, wParam, lParam);
+
+	// this is as soon as the thread could look at the input, the os' wakeup delay is already in it
+	const cbf::TimestampType time = cbf::getCurrentTime();
+	uint32_t queued = 0;
+	CBF_TRACE_BEGIN(Input);
+
+	// size is only the buffer's capacity going in, what was read is the return value
+	UINT size = rawInputBuffer.size();
+	const UINT bytesRead = GetRawInputData((HRAWINPUT)lParam, RID_INPUT, rawInputBuffer.data(), &size, sizeof(RAWINPUTHEADER));
+	if (bytesRead == (UINT)-1) {
+		cbf::Manager::get().inputLog.write(cbf::LogMessage::RawInputTooLarge, rawInputBuffer.size());
+	}
+	else queued = handleRawInput(cbf::decodeRawInput(std::span(rawInputBuffer).first(bytesRead)), time);
+
+	// anything queued behind this message is drained in blocks instead of one message + syscalls each
+	// those arrived before now, so now is their timestamp, same as if their messages were handled right here
+	while (true) {
+		UINT blockSize = rawInputBuffer.size();
+		const UINT count = GetRawInputBuffer(reinterpret_cast<PRAWINPUT>(rawInputBuffer.data()), &blockSize, sizeof(RAWINPUTHEADER));
+		if (count == 0 || count == (UINT)-1) break;
+
+		const cbf::TimestampType blockTime = cbf::getCurrentTime();
+		cbf::forEachRawInput(rawInputBuffer, count, [&](const cbf::RawInputEvent& event) {
+			queued += handleRawInput(event, blockTime);
+		});
+	}
+
+	if (queued) cbf::Manager::get().inputLatency.record(cbf::getCurrentTime() - time);
+	CBF_TRACE_END(Input, queued);
 
 	// prevent input from going through
 	return 0;
 }
 
-void inputThread() {
+void inputThread(cbf::InputThreadPolicy policy) {
+	CBF_TRACE_THREAD("input");
+	std::string policyError;
+	if (!cbf::applyInputThreadPolicy(policy, policyError)) log::warn("Input thread policy not fully applied: {}", policyError);
+
 	WNDCLASS wc = {};
 	wc.lpfnWndProc = WindowProc;
 	wc.hInstance = GetModuleHandleA(NULL);
@@ -159,41 +178,56 @@ void inputThread() {
 	}
 
 	MSG msg;
-	while (GetMessage(&msg, hwnd, 0, 0)) {
-		DispatchMessage(&msg);
+	if (policy.busyPoll) {
+		// no wait for the scheduler to wake the thread up, at the cost of keeping a core busy
+		while (true) {
+			if (!PeekMessage(&msg, hwnd, 0, 0, PM_REMOVE)) {
+				YieldProcessor();
+				continue;
+			}
+			if (msg.message == WM_QUIT) break;
+			DispatchMessage(&msg);
+		}
+	}
+	else {
+		while (GetMessage(&msg, hwnd, 0, 0)) {
+			DispatchMessage(&msg);
+		}
 	}
 }
 
 $on_mod(Loaded) {
-    std::thread(inputThread).detach();
+    // read once, the thread is started only once per launch
+    const cbf::InputThreadPolicy policy {
+        .highPriority = Mod::get()->getSettingValue<bool>("input-thread-priority"),
+        .core = static_cast<int>(Mod::get()->getSettingValue<int64_t>("input-thread-core")),
+        .busyPoll = Mod::get()->getSettingValue<bool>("input-busy-poll")
+    };
+    std::thread(inputThread, policy).detach();
 }
 
+// rebuilt off the input thread and swapped in, the input thread never waits on this
 void updateKeybinds() {
-	std::vector<geode::Ref<keybinds::Bind>> v;
-	auto& manager = cbf::Manager::get();
-
-	std::lock_guard lock(manager.keybindsLock);
-
-	manager.enableRightClick = Mod::get()->getSettingValue<bool>("right-click");
-	inputBinds->clear();
-
-	v = keybinds::BindManager::get()->getBindsFor("robtop.geometry-dash/jump-p1");
-	for (int i = 0; i < v.size(); i++) inputBinds[p1Jump].emplace(v[i]->getHash());
-
-	v = keybinds::BindManager::get()->getBindsFor("robtop.geometry-dash/move-left-p1");
-	for (int i = 0; i < v.size(); i++) inputBinds[p1Left].emplace(v[i]->getHash());
-
-	v = keybinds::BindManager::get()->getBindsFor("robtop.geometry-dash/move-right-p1");
-	for (int i = 0; i < v.size(); i++) inputBinds[p1Right].emplace(v[i]->getHash());
-
-	v = keybinds::BindManager::get()->getBindsFor("robtop.geometry-dash/jump-p2");
-	for (int i = 0; i < v.size(); i++) inputBinds[p2Jump].emplace(v[i]->getHash());
-
-	v = keybinds::BindManager::get()->getBindsFor("robtop.geometry-dash/move-left-p2");
-	for (int i = 0; i < v.size(); i++) inputBinds[p2Left].emplace(v[i]->getHash());
+	auto table = std::make_unique<cbf::KeybindTable>();
+	table->rightClick = Mod::get()->getSettingValue<bool>("right-click");
+
+	// same priority the per-action sets were probed in
+	const std::pair<const char*, std::pair<cbf::Player, PlayerButton>> actions[] = {
+		{ "robtop.geometry-dash/jump-p1", { cbf::Player::Player1, PlayerButton::Jump } },
+		{ "robtop.geometry-dash/move-left-p1", { cbf::Player::Player1, PlayerButton::Left } },
+		{ "robtop.geometry-dash/move-right-p1", { cbf::Player::Player1, PlayerButton::Right } },
+		{ "robtop.geometry-dash/jump-p2", { cbf::Player::Player2, PlayerButton::Jump } },
+		{ "robtop.geometry-dash/move-left-p2", { cbf::Player::Player2, PlayerButton::Left } },
+		{ "robtop.geometry-dash/move-right-p2", { cbf::Player::Player2, PlayerButton::Right } },
+	};
+
+	for (const auto& [action, target] : actions) {
+		for (const auto& bind : keybinds::BindManager::get()->getBindsFor(action)) {
+			table->bind(bind->getHash(), target.first, target.second);
+		}
+	}
 
-	v = keybinds::BindManager::get()->getBindsFor("robtop.geometry-dash/move-right-p2");
-	for (int i = 0; i < v.size(); i++) inputBinds[p2Right].emplace(v[i]->getHash());
+	cbf::Manager::get().keybinds.publish(std::move(table));
 }
 
 class $modify(PlayLayer) {
@@ -0,0 +1,32 @@
+#pragma once
+
+// the few assertions the tests need, a failed check is printed and the test keeps going
+// so one run shows everything that broke. main returns checkFailures() so ctest sees it
+
+#include <cstdio>
+
+namespace cbf::test {
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ::cbf::test::checkFailures()++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+    do { \
+        const double checkA = (a), checkB = (b); \
+        if (!(checkA - checkB <= (tolerance) && checkB - checkA <= (tolerance))) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s == %s (%.9f vs %.9f)\n", __FILE__, __LINE__, #a, #b, checkA, checkB); \
+            ::cbf::test::checkFailures()++; \
+        } \
+    } while (0)
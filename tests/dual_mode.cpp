@@ -0,0 +1,132 @@
+// Engine with dual mode splitting the players onto two timelines and joining them again: every queued
+// input is applied exactly once, whichever timeline gets it
+
+#include <memory>
+#include <vector>
+
+#include "check.hpp"
+#include "engine.hpp"
+
+namespace {
+
+using namespace cbf;
+
+constexpr Duration frameTime { 16'666'667 };
+constexpr int stepCount = 4;
+
+Duration ms(double value) {
+    return Duration(static_cast<int64_t>(value * 1'000'000));
+}
+
+class Harness {
+public:
+    Harness() {
+        engine->cutoffMode = CutoffMode::Physics;
+        engine->beginFrame(stepCount, false, now); // the first frame is never stepped
+    }
+
+    void input(Duration offset, Player player, InputState state, size_t lane = 0) {
+        engine->addInput(Input { .time = now + offset, .state = state, .player = player }, lane);
+    }
+
+    void beginFrame(bool split) {
+        now += frameTime;
+        engine->beginFrame(stepCount, split, now);
+    }
+
+    // steps a timeline through steps of the frame, or all that are left
+    void step(int timeline, int steps = stepCount) {
+        for (int i = 0; i < steps && !engine->timelines[timeline].stepGenerator.done(); i++) {
+            Step step;
+            do {
+                step = engine->nextStep(engine->timelines[timeline], [&](const Input& input) { applied.push_back(input); });
+            } while (!step.endStep);
+        }
+    }
+
+    // a frame where every active timeline takes all of its steps
+    void frame(bool split) {
+        beginFrame(split);
+        step(0);
+        if (split) step(1);
+    }
+
+    std::unique_ptr<Engine> engine = std::make_unique<Engine>();
+    TimestampType now = TimestampType(Duration(1'000'000'000));
+    std::vector<Input> applied;
+};
+
+// dual mode ends after p2 took one step, p1 already applied its inputs after that
+void splitEndingMidFrame() {
+    Harness h;
+    h.input(ms(1), Player::Player1, InputState::Press);
+    h.input(ms(10), Player::Player2, InputState::Press);
+    h.input(ms(13), Player::Player1, InputState::Release);
+    h.input(ms(14), Player::Player1, InputState::Press);
+
+    h.beginFrame(true);
+    h.step(0);
+    h.step(1, 1);
+    h.frame(false);
+    h.frame(false);
+
+    CHECK(h.applied.size() == 4);
+}
+
+// p2's release is only seen by its own timeline, joined again p1's timeline must not think it is still held
+void buttonsCarryOverSplits() {
+    Harness h;
+    h.input(ms(5), Player::Player2, InputState::Press);
+    h.frame(false);
+    h.input(ms(5), Player::Player2, InputState::Release);
+    h.frame(true);
+    h.input(ms(5), Player::Player2, InputState::Press);
+    h.frame(false);
+    h.frame(false);
+
+    CHECK(h.applied.size() == 3);
+    CHECK(h.engine->timelines[0].coalescer.droppedInputs == 0);
+}
+
+// an input from another lane arriving late must not be merged in among inputs one timeline already applied
+void lateInputAfterSplit() {
+    Harness h;
+    h.input(ms(2), Player::Player1, InputState::Press);
+    h.input(ms(5), Player::Player2, InputState::Press);
+    h.input(ms(9), Player::Player1, InputState::Release);
+    h.input(ms(12), Player::Player1, InputState::Press);
+
+    h.beginFrame(true);
+    h.step(0);
+    h.step(1, 1);
+
+    h.input(ms(10) - frameTime, Player::Player1, InputState::Release, 1);
+    h.frame(false);
+    h.frame(false);
+
+    CHECK(h.applied.size() == 5);
+    CHECK(h.engine->inputQueue.late() == 1);
+}
+
+// an input p2's last step carried is applied by p1's timeline once dual mode is over
+void carriedOverJoin() {
+    Harness h;
+    h.engine->maxExtraPasses = 1;
+    const Duration lastStep = frameTime * 3 / 4;
+    h.input(lastStep + ms(1), Player::Player2, InputState::Press);
+    h.input(lastStep + ms(2), Player::Player2, InputState::Release);
+    h.frame(true);
+    h.frame(false);
+
+    CHECK(h.applied.size() == 2);
+}
+
+}
+
+int main() {
+    splitEndingMidFrame();
+    buttonsCarryOverSplits();
+    lateInputAfterSplit();
+    carriedOverJoin();
+    return test::checkFailures() != 0;
+}
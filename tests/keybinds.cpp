@@ -0,0 +1,88 @@
+// KeybindTable lookups and Published handing tables to the input thread
+
+#include <array>
+#include <atomic>
+#include <thread>
+
+#include "check.hpp"
+#include "keybinds.hpp"
+
+namespace {
+
+using namespace cbf;
+
+// the first bind of a key wins, later ones for the same key are ignored
+void firstBindWins() {
+    KeybindTable table;
+    table.bind(32, Player::Player1, PlayerButton::Jump);
+    table.bind(32, Player::Player2, PlayerButton::Left);
+    table.bind(37, Player::Player2, PlayerButton::Left);
+
+    CHECK(table.find(32).bound);
+    CHECK(table.find(32).player == Player::Player1);
+    CHECK(table.find(32).button == PlayerButton::Jump);
+    CHECK(table.find(37).player == Player::Player2);
+    CHECK(table.find(37).button == PlayerButton::Left);
+    CHECK(!table.find(38).bound);
+}
+
+// keys past the table are never bound and look up as unbound
+void outOfRangeKeys() {
+    KeybindTable table;
+    table.bind(KeybindTable::keyCount, Player::Player1, PlayerButton::Jump);
+    table.bind(0xffffffff, Player::Player1, PlayerButton::Jump);
+
+    CHECK(!table.find(KeybindTable::keyCount).bound);
+    CHECK(!table.find(0xffffffff).bound);
+    CHECK(!table.find(KeybindTable::keyCount - 1).bound);
+
+    table.bind(KeybindTable::keyCount - 1, Player::Player2, PlayerButton::Right);
+    CHECK(table.find(KeybindTable::keyCount - 1).bound);
+}
+
+// the reader always sees a whole value, never one half replaced, and never goes back to an older one
+void publishUnderReader() {
+    using Value = std::array<uint64_t, 16>;
+    constexpr uint64_t publishes = 20000;
+
+    Published<Value> published;
+    std::atomic<bool> done = false;
+    int torn = 0;
+    int backwards = 0;
+    uint64_t reads = 0;
+
+    std::thread reader([&] {
+        uint64_t last = 0;
+        while (!done.load(std::memory_order_acquire)) {
+            auto value = published.read();
+            for (uint64_t entry : *value) {
+                if (entry != (*value)[0]) torn++;
+            }
+            if ((*value)[0] < last) backwards++;
+            last = (*value)[0];
+            reads++;
+        }
+    });
+
+    for (uint64_t i = 1; i <= publishes; i++) {
+        auto value = std::make_unique<Value>();
+        value->fill(i);
+        published.publish(std::move(value));
+    }
+    done.store(true, std::memory_order_release);
+    reader.join();
+
+    CHECK(torn == 0);
+    CHECK(backwards == 0);
+    CHECK(reads > 0);
+    CHECK((*published.read())[15] == publishes);
+}
+
+}
+
+int main() {
+    firstBindWins();
+    outOfRangeKeys();
+    publishUnderReader();
+    return test::checkFailures() != 0;
+}
@@ -0,0 +1,91 @@
+// StepGenerator through Engine::nextStep: however inputs are split, capped or carried, every physics
+// step still adds up to exactly one step of movement
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "engine.hpp"
+
+namespace {
+
+using namespace cbf;
+
+constexpr Duration frameTime { 16'666'667 };
+
+TimestampType at(Duration offset) {
+    return TimestampType(Duration(1'000'000'000)) + offset;
+}
+
+// runs one frame of stepCount steps with inputs at the given offsets into it, returns each step's deltaFactor sum
+std::vector<double> runFrame(int stepCount, int maxSubSteps, int maxExtraPasses, const std::vector<Duration>& inputs) {
+    auto engine = std::make_unique<Engine>();
+    engine->cutoffMode = CutoffMode::Physics;
+    engine->maxSubSteps = maxSubSteps;
+    engine->maxExtraPasses = maxExtraPasses;
+    engine->beginFrame(stepCount, false, at(Duration::zero())); // the first frame is never stepped
+
+    InputState state = InputState::Press;
+    for (Duration offset : inputs) {
+        engine->addInput(Input { .time = at(offset), .state = state });
+        state = state == InputState::Press ? InputState::Release : InputState::Press;
+    }
+    engine->beginFrame(stepCount, false, at(frameTime));
+
+    std::vector<double> sums(stepCount, 0.0);
+    for (int i = 0; i < stepCount; i++) {
+        Step step;
+        do {
+            step = engine->nextStep(engine->timelines[0], [](const Input&) {});
+            CHECK(step.stepIndex == i);
+            sums[i] += step.deltaFactor;
+        } while (!step.endStep);
+    }
+    return sums;
+}
+
+void checkWholeSteps(const std::vector<double>& sums) {
+    for (double sum : sums) CHECK_NEAR(sum, 1.0, 1e-9);
+}
+
+// the extra pass cap runs out in the middle of a step that was already split
+void cappedInsideSplitStep() {
+    const Duration step = frameTime / 4;
+    checkWholeSteps(runFrame(4, 48, 1, { step + step / 5, step + step / 2 }));
+    checkWholeSteps(runFrame(4, 48, 2, { step / 3, step + step / 5, step + step / 2, step + step * 3 / 4 }));
+    checkWholeSteps(runFrame(4, 48, 0, { step / 2 }));
+}
+
+// steps before the sub-step cap carry their inputs, later ones split
+void carriedBeforeSubSteps() {
+    const Duration step = frameTime / 16;
+    checkWholeSteps(runFrame(16, 4, 48, { step / 2, step * 3 / 2, step * 13 + step / 3, step * 15 + step / 2 }));
+}
+
+void randomFrames() {
+    std::mt19937_64 rng(1);
+    for (int frame = 0; frame < 2000; frame++) {
+        const int stepCount = std::uniform_int_distribution<int>(1, 24)(rng);
+        std::vector<Duration> inputs(std::uniform_int_distribution<int>(0, 12)(rng));
+        for (Duration& input : inputs) input = Duration(std::uniform_int_distribution<int64_t>(1, frameTime.count())(rng));
+        std::sort(inputs.begin(), inputs.end());
+
+        checkWholeSteps(runFrame(
+            stepCount,
+            std::uniform_int_distribution<int>(1, 32)(rng),
+            std::uniform_int_distribution<int>(0, 6)(rng),
+            inputs
+        ));
+    }
+}
+
+}
+
+int main() {
+    cappedInsideSplitStep();
+    carriedBeforeSubSteps();
+    randomFrames();
+    return test::checkFailures() != 0;
+}
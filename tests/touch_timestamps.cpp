@@ -0,0 +1,68 @@
+// TouchTimestampQueue matching the launcher's MotionEvent reports to the touches cocos dispatches
+
+#include "check.hpp"
+#include "engine.hpp"
+
+namespace {
+
+using namespace cbf;
+
+TimestampType at(int64_t ms) {
+    return TimestampType(std::chrono::seconds(10) + std::chrono::milliseconds(ms));
+}
+
+// each pointer and action gets its own report, even out of order
+void matchesPointerAndAction() {
+    TouchTimestampQueue queue;
+    queue.record({ at(1), 0, TouchAction::Down });
+    queue.record({ at(2), 1, TouchAction::Down });
+    queue.record({ at(3), 0, TouchAction::Up });
+
+    CHECK(queue.take(1, TouchAction::Down, at(5)) == at(2));
+    CHECK(queue.take(0, TouchAction::Up, at(5)) == at(3));
+    CHECK(queue.take(0, TouchAction::Down, at(5)) == at(1));
+    CHECK(queue.take(0, TouchAction::Down, at(5)) == TimestampType {});
+    CHECK(queue.unmatched() == 1);
+}
+
+// reports for touches dispatched without them are dropped once they are too old to belong to anything
+void dropsOldReports() {
+    TouchTimestampQueue queue;
+    queue.record({ at(0), 0, TouchAction::Down });
+    queue.record({ at(150), 0, TouchAction::Down });
+
+    CHECK(queue.take(0, TouchAction::Down, at(160)) == at(150));
+    CHECK(queue.stale() == 1);
+}
+
+// older launchers report every MotionEvent without saying which, moves included. a touch gets the newest
+void legacyReportsTakeTheNewest() {
+    TouchTimestampQueue queue;
+    queue.record({ .time = at(1) }); // down
+    CHECK(queue.take(0, TouchAction::Down, at(2)) == at(1));
+
+    for (int64_t ms = 10; ms < 90; ms += 8) queue.record({ .time = at(ms) }); // moves
+    queue.record({ .time = at(95) }); // up
+    CHECK(queue.take(0, TouchAction::Up, at(96)) == at(95));
+    CHECK(queue.take(0, TouchAction::Down, at(97)) == TimestampType {});
+}
+
+// the pending reports never grow past maxPending, the oldest go first
+void boundedPending() {
+    TouchTimestampQueue queue;
+    for (int i = 0; i < 40; i++) queue.record({ at(i), i, TouchAction::Down });
+
+    CHECK(queue.take(39, TouchAction::Down, at(40)) == at(39));
+    CHECK(queue.take(0, TouchAction::Down, at(40)) == TimestampType {});
+    CHECK(queue.stale() == 40 - TouchTimestampQueue::maxPending);
+}
+
+}
+
+int main() {
+    matchesPointerAndAction();
+    dropsOldReports();
+    legacyReportsTakeTheNewest();
+    boundedPending();
+    return test::checkFailures() != 0;
+}
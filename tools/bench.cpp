@@ -0,0 +1,548 @@
+// microbenchmarks for the scheduler hot path
+// prints one JSON document so results can be diffed between releases, with what a timing window costs
+// on its own (timerOverhead) next to them
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "deferred_log.hpp"
+#include "engine.hpp"
+#include "keybinds.hpp"
+#include "rawinput.hpp"
+#include "step_cost.hpp"
+
+// counting allocator hook, every allocation in the process goes through here
+static std::atomic<uint64_t> g_allocations = 0;
+
+void* operator new(size_t size) {
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// hardware cycle and instruction counters for the calling thread, if the kernel lets us have them
+class PerfCounters {
+public:
+	PerfCounters() {
+#ifdef __linux__
+		cyclesFd = open(PERF_COUNT_HW_CPU_CYCLES, -1);
+		if (cyclesFd >= 0) instructionsFd = open(PERF_COUNT_HW_INSTRUCTIONS, cyclesFd);
+#endif
+	}
+
+	~PerfCounters() {
+#ifdef __linux__
+		if (instructionsFd >= 0) close(instructionsFd);
+		if (cyclesFd >= 0) close(cyclesFd);
+#endif
+	}
+
+	bool available() const { return cyclesFd >= 0; }
+
+	void start() {
+#ifdef __linux__
+		if (cyclesFd < 0) return;
+		ioctl(cyclesFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(cyclesFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+	}
+
+	void stop(uint64_t& cycles, uint64_t& instructions) {
+		cycles = instructions = 0;
+#ifdef __linux__
+		if (cyclesFd < 0) return;
+		ioctl(cyclesFd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		if (read(cyclesFd, &cycles, sizeof(cycles)) != sizeof(cycles)) cycles = 0;
+		if (instructionsFd >= 0 && read(instructionsFd, &instructions, sizeof(instructions)) != sizeof(instructions)) instructions = 0;
+#endif
+	}
+
+private:
+#ifdef __linux__
+	static int open(uint64_t config, int group) {
+		perf_event_attr attr {};
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config;
+		attr.disabled = group < 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+	}
+#endif
+
+	int cyclesFd = -1;
+	int instructionsFd = -1;
+};
+
+struct Result {
+	std::string name;
+	std::string params;
+	uint64_t ops = 0;
+	uint64_t opsPerWindow = 1;
+	double nsPerOp = 0.0;
+	double allocationsPerOp = 0.0;
+	double cyclesPerOp = -1.0;
+	double instructionsPerOp = -1.0;
+};
+
+// what one timing window costs on its own: the two clock reads and the counter ioctls
+struct Overhead {
+	double ns = 0.0;
+	double cycles = 0.0;
+	double instructions = 0.0;
+};
+
+std::vector<Result> g_results;
+PerfCounters* g_perf = nullptr;
+Overhead g_overhead;
+
+// ops without setup are timed this many to a window, so the window itself is noise
+constexpr uint64_t windowOps = 1024;
+
+struct Window {
+	uint64_t ns = 0;
+	uint64_t allocations = 0;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+};
+
+template <typename Op>
+Window timeWindow(Op&& op) {
+	Window window;
+	const uint64_t allocations = g_allocations.load(std::memory_order_relaxed);
+	g_perf->start();
+	const auto start = std::chrono::steady_clock::now();
+
+	op();
+
+	const auto end = std::chrono::steady_clock::now();
+	g_perf->stop(window.cycles, window.instructions);
+	window.allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+	window.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	return window;
+}
+
+void addResult(const std::string& name, const std::string& params, uint64_t ops, uint64_t opsPerWindow, const Window& total, uint64_t windows) {
+	Result result { name, params, ops, opsPerWindow };
+	result.nsPerOp = std::max(0.0, total.ns - g_overhead.ns * windows) / ops;
+	result.allocationsPerOp = static_cast<double>(total.allocations) / ops;
+	if (g_perf->available()) {
+		result.cyclesPerOp = std::max(0.0, total.cycles - g_overhead.cycles * windows) / ops;
+		result.instructionsPerOp = std::max(0.0, total.instructions - g_overhead.instructions * windows) / ops;
+	}
+	g_results.push_back(result);
+}
+
+// an empty window, many times over
+void measureOverhead(uint64_t windows) {
+	Window total;
+	for (uint64_t i = 0; i < windows; i++) {
+		const Window window = timeWindow([] {});
+		total.ns += window.ns;
+		total.cycles += window.cycles;
+		total.instructions += window.instructions;
+	}
+	g_overhead.ns = static_cast<double>(total.ns) / windows;
+	g_overhead.cycles = static_cast<double>(total.cycles) / windows;
+	g_overhead.instructions = static_cast<double>(total.instructions) / windows;
+}
+
+// op is timed windowOps at a time and the overhead of each window is taken off
+template <typename Op>
+void bench(const std::string& name, const std::string& params, uint64_t ops, Op&& op) {
+	Window total;
+	uint64_t windows = 0;
+	for (uint64_t done = 0; done < ops; windows++) {
+		const uint64_t batch = std::min(windowOps, ops - done);
+		const Window window = timeWindow([&] {
+			for (uint64_t i = 0; i < batch; i++) op();
+		});
+		total.ns += window.ns;
+		total.allocations += window.allocations;
+		total.cycles += window.cycles;
+		total.instructions += window.instructions;
+		done += batch;
+	}
+	addResult(name, params, ops, windowOps, total, windows);
+}
+
+// setup runs untimed before every op, so op gets a window of its own. only for ops well above the
+// window overhead, which is measured up front and taken off
+template <typename Setup, typename Op>
+void bench(const std::string& name, const std::string& params, uint64_t ops, Setup&& setup, Op&& op) {
+	Window total;
+	for (uint64_t i = 0; i < ops; i++) {
+		setup();
+		const Window window = timeWindow(op);
+		total.ns += window.ns;
+		total.allocations += window.allocations;
+		total.cycles += window.cycles;
+		total.instructions += window.instructions;
+	}
+	addResult(name, params, ops, 1, total, ops);
+}
+
+constexpr cbf::Duration frameTime { 16'666'667 }; // 60fps
+
+// queues inputs spread evenly over the next frame window and starts the loop, like the input thread + clearQueuesBeforeLoop would
+void queueFrame(cbf::Engine& engine, cbf::TimestampType& now, int inputs) {
+	for (int i = 0; i < inputs; i++) {
+		const auto state = i % 2 ? cbf::InputState::Release : cbf::InputState::Press;
+		engine.addInput(cbf::Input { .time = now + cbf::Duration(1) + (frameTime - cbf::Duration(1)) * i / std::max(1, inputs), .state = state });
+	}
+	now += frameTime;
+	engine.beginLoop(now);
+}
+
+void consumeFrame(cbf::Engine& engine, int stepCount) {
+	for (int i = 0; i < stepCount; i++) {
+		cbf::Step step;
+		do {
+			step = engine.nextStep(engine.timelines[0], [](const cbf::Input&) {});
+		} while (!step.endStep);
+	}
+}
+
+void benchAddInputContended(uint64_t ops) {
+	auto engine = std::make_unique<cbf::Engine>();
+	std::atomic<bool> stop = false;
+
+	// the game thread keeps taking and releasing batches while the input thread pushes
+	std::thread consumer([&] {
+		while (!stop.load(std::memory_order_relaxed)) {
+			engine->inputQueue.takeBatch(cbf::TimestampType::max());
+			engine->inputQueue.release(engine->inputQueue.batchEnd());
+		}
+	});
+
+	cbf::TimestampType time {};
+	bench("addInput", "{\"consumer\":\"concurrent\"}", ops, [&] {
+		time += cbf::Duration(1);
+		engine->addInput(cbf::Input { .time = time });
+	});
+
+	stop = true;
+	consumer.join();
+}
+
+// a sub-step debug message from the physics hook, with the flush thread draining concurrently
+void benchDeferredLog(uint64_t ops) {
+	auto log = std::make_unique<cbf::DeferredLog>();
+	std::atomic<bool> stop = false;
+
+	std::thread flusher([&] {
+		while (!stop.load(std::memory_order_relaxed)) {
+			log->drain([](const cbf::LogRecord&) {});
+			std::this_thread::sleep_for(std::chrono::microseconds(100)); // often enough that the ring never fills
+		}
+	});
+
+	for (bool enabled : { false, true }) {
+		log->setEnabled(enabled);
+		double timeFactor = 0.0;
+		bench("deferredLog", enabled ? "{\"enabled\":true}" : "{\"enabled\":false}", ops, [&] {
+			timeFactor += 0.001;
+			log->write(cbf::LogMessage::SubStep, timeFactor, 0.5);
+		});
+	}
+
+	stop = true;
+	flusher.join();
+}
+
+// the samples around one extra pass in the PlayerObject::update hook, a frame ending every 16 of them
+void benchStepCost(uint64_t ops) {
+	cbf::StepCost cost;
+	for (bool enabled : { false, true }) {
+		cost.setEnabled(enabled);
+		uint64_t sampled = 0;
+		bench("stepCost", enabled ? "{\"enabled\":true}" : "{\"enabled\":false}", ops, [&] {
+			uint64_t started = cost.start();
+			started = cost.lap(cbf::CostPhase::Update, true, started);
+			started = cost.lap(cbf::CostPhase::Collisions, true, started);
+			started = cost.lap(cbf::CostPhase::Rotation, true, started);
+			cost.lap(cbf::CostPhase::ResetCollisionLog, true, started);
+			if (++sampled % 16 == 0) cost.endFrame();
+		});
+	}
+}
+
+// what the input thread does per key event, with the table being republished every 100us
+void benchKeybindLookup(uint64_t ops) {
+	cbf::Published<cbf::KeybindTable> keybinds;
+	std::atomic<bool> stop = false;
+
+	std::thread publisher([&] {
+		while (!stop.load(std::memory_order_relaxed)) {
+			auto table = std::make_unique<cbf::KeybindTable>();
+			table->bind(' ', cbf::Player::Player1, PlayerButton::Jump);
+			keybinds.publish(std::move(table));
+			std::this_thread::sleep_for(std::chrono::microseconds(100)); // its allocations would show up in allocationsPerOp otherwise
+		}
+	});
+
+	uint32_t key = 0;
+	bool bound = false;
+	bench("keybindLookup", "{\"publisher\":\"concurrent\"}", ops, [&] {
+		bound ^= keybinds.read()->find(key++ & 0xff).bound;
+	});
+
+	stop = true;
+	publisher.join();
+	if (bound) std::fprintf(stderr, "\n"); // keeps the lookups from being optimized out
+}
+
+// RAWINPUT packets as GetRawInputData returns them on x64 (hDevice/wParam zeroed)
+constexpr uint8_t spaceDownPacket[] = {
+	0x01, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, // RIM_TYPEKEYBOARD, 40 bytes
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x39, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, // scan code 0x39, make, VK_SPACE
+	0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // WM_KEYDOWN
+};
+constexpr uint8_t spaceUpPacket[] = {
+	0x01, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x39, 0x00, 0x01, 0x00, 0x00, 0x00, 0x20, 0x00, // RI_KEY_BREAK
+	0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // WM_KEYUP
+};
+constexpr uint8_t leftDownPacket[] = {
+	0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00, // RIM_TYPEMOUSE, 48 bytes
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, // RI_MOUSE_BUTTON_1_DOWN
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+constexpr uint8_t movePacket[] = {
+	0x00, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // no buttons
+	0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, // lLastX = 3
+	0xfe, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, // lLastY = -2
+};
+
+void benchRawInput(uint64_t ops) {
+	const std::span<const std::byte> fixtures[] = {
+		std::as_bytes(std::span(spaceDownPacket)), std::as_bytes(std::span(spaceUpPacket)),
+		std::as_bytes(std::span(leftDownPacket)), std::as_bytes(std::span(movePacket)),
+	};
+
+	// the decoder has to get the fixtures right before its speed means anything
+	const auto check = [](std::span<const std::byte> packet, cbf::RawInputKind kind, cbf::InputState state) {
+		const auto event = cbf::decodeRawInput(packet);
+		if (event.kind != kind || (kind != cbf::RawInputKind::Other && event.state != state)) {
+			std::fprintf(stderr, "raw input fixture decoded wrong\n");
+			std::exit(1);
+		}
+	};
+	check(fixtures[0], cbf::RawInputKind::Keyboard, cbf::InputState::Press);
+	check(fixtures[1], cbf::RawInputKind::Keyboard, cbf::InputState::Release);
+	check(fixtures[2], cbf::RawInputKind::Mouse, cbf::InputState::Press);
+	check(fixtures[3], cbf::RawInputKind::Other, cbf::InputState::Press);
+
+	size_t next = 0;
+	int events = 0;
+	bench("decodeRawInput", "{}", ops, [&] {
+		events += static_cast<int>(cbf::decodeRawInput(fixtures[next++ & 3]).kind);
+	});
+
+	// a GetRawInputBuffer block of 64 packets, mostly mouse movement like a 8khz mouse would send
+	alignas(8) std::array<std::byte, 64 * 48> block {};
+	size_t offset = 0;
+	for (int i = 0; i < 64; i++) {
+		const auto packet = i % 16 == 0 ? fixtures[i / 16 % 3] : fixtures[3];
+		std::memcpy(block.data() + offset, packet.data(), packet.size());
+		offset += (packet.size() + cbf::rawinput::blockAlignment - 1) & ~(cbf::rawinput::blockAlignment - 1);
+	}
+
+	bench("forEachRawInput", "{\"packets\":64}", ops, [&] {
+		cbf::forEachRawInput(block, 64, [&](const cbf::RawInputEvent& event) {
+			events += static_cast<int>(event.kind);
+		});
+	});
+	Result& result = g_results.back();
+	result.nsPerOp /= 64;
+	result.allocationsPerOp /= 64;
+	if (result.cyclesPerOp >= 0) {
+		result.cyclesPerOp /= 64;
+		result.instructionsPerOp /= 64;
+	}
+
+	if (events < 0) std::fprintf(stderr, "\n"); // keeps the decoding from being optimized out
+}
+
+void benchDrain(uint64_t ops) {
+	for (size_t cutoff = 0; cutoff < static_cast<size_t>(cbf::CutoffMode::Count); cutoff++) {
+		for (int inputs : { 0, 1, 8, 64 }) {
+			auto engine = std::make_unique<cbf::Engine>();
+			engine->cutoffMode = static_cast<cbf::CutoffMode>(cutoff);
+			cbf::TimestampType now {};
+
+			queueFrame(*engine, now, 0);
+			engine->beginFrame(4, false, now);
+
+			bench("beginFrame", "{\"cutoff\":\"" + std::string(cbf::cutoffModeNames[cutoff]) + "\",\"inputs\":" + std::to_string(inputs) + "}", ops,
+				[&] {
+					consumeFrame(*engine, 4);
+					queueFrame(*engine, now, inputs);
+				},
+				[&] { engine->beginFrame(4, false, now); }
+			);
+		}
+	}
+}
+
+// beginFrame with a frame's inputs spread round robin over several lanes, so the merge has to interleave them
+void benchMerge(uint64_t ops) {
+	constexpr int inputs = 64;
+	for (size_t lanes : { size_t(1), size_t(2), cbf::inputLanes }) {
+		auto engine = std::make_unique<cbf::Engine>();
+		cbf::TimestampType now {};
+
+		queueFrame(*engine, now, 0);
+		engine->beginFrame(4, false, now);
+
+		bench("mergeLanes", "{\"lanes\":" + std::to_string(lanes) + ",\"inputs\":" + std::to_string(inputs) + "}", ops,
+			[&] {
+				consumeFrame(*engine, 4);
+				for (int i = 0; i < inputs; i++) {
+					const auto state = i % 2 ? cbf::InputState::Release : cbf::InputState::Press;
+					engine->addInput(cbf::Input { .time = now + cbf::Duration(1) + (frameTime - cbf::Duration(1)) * i / inputs, .state = state }, i % lanes);
+				}
+				now += frameTime;
+				engine->beginLoop(now);
+			},
+			[&] { engine->beginFrame(4, false, now); }
+		);
+	}
+}
+
+void benchStepPlan(uint64_t ops) {
+	for (int stepCount : { 1, 4, 16, 64, 500 }) {
+		for (int inputs : { 0, 1, 8, 64 }) {
+			auto engine = std::make_unique<cbf::Engine>();
+			engine->maxSubSteps = 1000;
+			engine->maxExtraPasses = 1000;
+			cbf::TimestampType now {};
+
+			queueFrame(*engine, now, 0);
+			engine->beginFrame(stepCount, false, now);
+
+			const std::string params = "{\"stepCount\":" + std::to_string(stepCount) + ",\"inputs\":" + std::to_string(inputs) + "}";
+
+			// plan + consume a whole frame, this is everything CBF adds to one physics frame
+			bench("frame", params, ops,
+				[&] {
+					consumeFrame(*engine, stepCount);
+					queueFrame(*engine, now, inputs);
+				},
+				[&] {
+					engine->beginFrame(stepCount, false, now);
+					consumeFrame(*engine, stepCount);
+				}
+			);
+
+			// consumption on its own, per nextStep call
+			uint64_t pulls = 0;
+			bench("nextStep", params, ops,
+				[&] {
+					queueFrame(*engine, now, inputs);
+					engine->beginFrame(stepCount, false, now);
+				},
+				[&] {
+					for (int i = 0; i < stepCount; i++) {
+						cbf::Step step;
+						do {
+							step = engine->nextStep(engine->timelines[0], [](const cbf::Input&) {});
+							pulls++;
+						} while (!step.endStep);
+					}
+				}
+			);
+			Result& result = g_results.back();
+			const double pullsPerOp = static_cast<double>(pulls) / ops;
+			result.nsPerOp /= pullsPerOp;
+			result.allocationsPerOp /= pullsPerOp;
+			if (result.cyclesPerOp >= 0) {
+				result.cyclesPerOp /= pullsPerOp;
+				result.instructionsPerOp /= pullsPerOp;
+			}
+		}
+	}
+}
+
+void printJson() {
+	std::printf("{\n\t\"perfCounters\": %s,\n", g_perf->available() ? "true" : "false");
+	std::printf("\t\"timerOverhead\": {\"nsPerWindow\": %.3f", g_overhead.ns);
+	if (g_perf->available()) std::printf(", \"cyclesPerWindow\": %.1f, \"instructionsPerWindow\": %.1f", g_overhead.cycles, g_overhead.instructions);
+	std::printf("},\n\t\"benchmarks\": [\n");
+	for (size_t i = 0; i < g_results.size(); i++) {
+		const Result& r = g_results[i];
+		std::printf("\t\t{\"name\": \"%s\", \"params\": %s, \"ops\": %" PRIu64 ", \"opsPerWindow\": %" PRIu64 ", \"nsPerOp\": %.3f, \"allocationsPerOp\": %.4f",
+			r.name.c_str(), r.params.c_str(), r.ops, r.opsPerWindow, r.nsPerOp, r.allocationsPerOp);
+		if (r.cyclesPerOp >= 0) std::printf(", \"cyclesPerOp\": %.1f, \"instructionsPerOp\": %.1f", r.cyclesPerOp, r.instructionsPerOp);
+		std::printf("}%s\n", i + 1 < g_results.size() ? "," : "");
+	}
+	std::printf("\t]\n}\n");
+}
+
+}
+
+int main(int argc, char** argv) {
+	uint64_t ops = 20'000;
+	if (argc > 2 && !std::strcmp(argv[1], "--ops")) ops = std::strtoull(argv[2], nullptr, 10);
+	else if (argc > 1) {
+		std::fprintf(stderr, "usage: %s [--ops N]\n", argv[0]);
+		return 1;
+	}
+
+	PerfCounters perf;
+	g_perf = &perf;
+	g_results.reserve(64);
+	measureOverhead(ops * 10);
+
+	benchAddInputContended(ops * 50);
+	benchKeybindLookup(ops * 50);
+	benchDeferredLog(ops * 50);
+	benchStepCost(ops * 50);
+	benchRawInput(ops * 10);
+	benchDrain(ops);
+	benchMerge(ops);
+	benchStepPlan(ops);
+
+	printJson();
+	return 0;
+}
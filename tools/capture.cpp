@@ -0,0 +1,231 @@
+// end to end capture check on linux: inputs from an evdev device (or a uinput virtual mouse this
+// tool clicks itself) go through EvdevSource into a real Engine driven at a fixed frame rate
+// reports how old each input was when its frame picked it up and what the clock aligner saw
+
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "evdev.hpp"
+#include "recording.hpp"
+
+namespace {
+
+struct Options {
+	std::string device;
+	int uinputClicks = 0;
+	double rate = 20.0; // uinput clicks per second
+	double seconds = 10.0; // how long to capture from a real device
+	double fps = 60.0;
+	std::string record; // session recording for cbf_replay
+	cbf::InputThreadPolicy policy;
+};
+
+// a virtual mouse with a left button, removed again when this goes away
+class VirtualMouse {
+public:
+	bool create() {
+		fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0) return false;
+
+		ioctl(fd, UI_SET_EVBIT, EV_KEY);
+		ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+
+		uinput_setup setup {};
+		setup.id.bustype = BUS_VIRTUAL;
+		setup.id.vendor = 0xcbf;
+		setup.id.product = 0x1;
+		std::strcpy(setup.name, "cbf virtual mouse");
+		if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) return false;
+
+		char sysname[64] = {};
+		if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) return false;
+
+		// the event node shows up under the device's sysfs dir once udev is done with it
+		const std::string dir = std::string("/sys/devices/virtual/input/") + sysname;
+		for (int attempt = 0; attempt < 100 && node.empty(); attempt++) {
+			for (int i = 0; i < 1024; i++) {
+				const std::string event = "event" + std::to_string(i);
+				if (access((dir + "/" + event).c_str(), F_OK) == 0) {
+					node = "/dev/input/" + event;
+					break;
+				}
+			}
+			if (node.empty()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return !node.empty();
+	}
+
+	~VirtualMouse() {
+		if (fd < 0) return;
+		ioctl(fd, UI_DEV_DESTROY);
+		close(fd);
+	}
+
+	void click(bool down) {
+		const input_event events[] = {
+			{ .time = {}, .type = EV_KEY, .code = BTN_LEFT, .value = down },
+			{ .time = {}, .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+		};
+		if (write(fd, events, sizeof(events)) != sizeof(events)) std::perror("uinput write");
+	}
+
+	const std::string& path() const { return node; }
+
+private:
+	int fd = -1;
+	std::string node;
+};
+
+int64_t us(cbf::Duration duration) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (arg == "--device" && value) options.device = argv[++i];
+		else if (arg == "--uinput" && value) options.uinputClicks = std::atoi(argv[++i]);
+		else if (arg == "--rate" && value) options.rate = std::atof(argv[++i]);
+		else if (arg == "--seconds" && value) options.seconds = std::atof(argv[++i]);
+		else if (arg == "--fps" && value) options.fps = std::atof(argv[++i]);
+		else if (arg == "--priority") options.policy.highPriority = true;
+		else if (arg == "--core" && value) options.policy.core = std::atoi(argv[++i]);
+		else if (arg == "--busy-poll") options.policy.busyPoll = true;
+		else if (arg == "--record" && value) options.record = argv[++i];
+		else {
+			std::fprintf(stderr, "usage: %s (--device /dev/input/eventN [--seconds S] | --uinput CLICKS [--rate HZ]) [--fps FPS] [--priority] [--core N] [--busy-poll] [--record out.cbfrec]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (options.device.empty() == (options.uinputClicks == 0) || options.fps <= 0 || options.rate <= 0) {
+		std::fprintf(stderr, "need exactly one of --device or --uinput\n");
+		return 1;
+	}
+
+	std::unique_ptr<VirtualMouse> mouse;
+	if (options.uinputClicks) {
+		mouse = std::make_unique<VirtualMouse>();
+		if (!mouse->create()) {
+			std::fprintf(stderr, "cant create a uinput device: %s\n", std::strerror(errno));
+			return 1;
+		}
+		options.device = mouse->path();
+		options.seconds = options.uinputClicks * 2 / options.rate + 0.5;
+	}
+
+	auto engine = std::make_unique<cbf::Engine>();
+	cbf::Recorder recorder;
+	if (!options.record.empty()) {
+		std::string error;
+		if (!recorder.start(options.record.c_str(), error)) {
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		engine->recorder = &recorder;
+	}
+	cbf::EvdevSource source(*engine, options.device);
+	source.setThreadPolicy(options.policy);
+	if (!source.start()) {
+		std::fprintf(stderr, "%s\n", source.error().c_str());
+		return 1;
+	}
+	if (!source.threadPolicyError().empty()) std::fprintf(stderr, "thread policy not fully applied: %s\n", source.threadPolicyError().c_str());
+	std::printf("capturing from %s, kernel timestamps %s\n", source.identity().c_str(),
+		source.monotonicTimestamps() ? "on CLOCK_MONOTONIC" : "on CLOCK_REALTIME (aligned)");
+
+	// clicks go in from their own thread, like a person would, and remember when they were sent
+	std::vector<cbf::TimestampType> sent;
+	sent.reserve(options.uinputClicks * 2);
+	std::thread clicker;
+	if (mouse) {
+		clicker = std::thread([&] {
+			const auto gap = std::chrono::duration<double>(1.0 / options.rate / 2);
+			for (int i = 0; i < options.uinputClicks * 2; i++) {
+				std::this_thread::sleep_for(gap);
+				sent.push_back(cbf::getCurrentTime());
+				mouse->click(i % 2 == 0);
+			}
+		});
+	}
+
+	// game loop, 4 steps a frame like 240 tps at 60fps
+	std::vector<cbf::TimestampType> applied;
+	std::vector<int64_t> ageUs;
+	const auto frameTime = std::chrono::duration_cast<cbf::Duration>(std::chrono::duration<double>(1.0 / options.fps));
+	const auto end = cbf::getCurrentTime() + std::chrono::duration_cast<cbf::Duration>(std::chrono::duration<double>(options.seconds));
+	auto nextFrame = cbf::getCurrentTime();
+
+	while (cbf::getCurrentTime() < end) {
+		nextFrame += frameTime;
+		std::this_thread::sleep_until(std::chrono::steady_clock::time_point(nextFrame.time_since_epoch()));
+
+		const auto now = cbf::getCurrentTime();
+		engine->beginLoop(now);
+		engine->beginFrame(4, false, now);
+		for (int step = 0; step < 4; step++) {
+			cbf::Step next;
+			do {
+				next = engine->nextStep(engine->timelines[0], [&](const cbf::Input& input) {
+					applied.push_back(input.time);
+					ageUs.push_back(us(now - input.time));
+				});
+			} while (!next.endStep);
+		}
+	}
+
+	if (clicker.joinable()) clicker.join();
+	source.stop();
+	engine->recorder = nullptr;
+	recorder.stop();
+
+	const auto& aligner = source.clockAligner();
+	std::printf("events %llu, applied %zu, kernel drops %llu, queue overflows %llu\n",
+		static_cast<unsigned long long>(source.events.load()), applied.size(),
+		static_cast<unsigned long long>(source.droppedReports.load()), static_cast<unsigned long long>(engine->inputQueue.overflows()));
+	std::printf("aligner: %llu aligned (%llu clamped), %llu missing, %llu rejected, offset %lldus\n",
+		static_cast<unsigned long long>(aligner.aligned()), static_cast<unsigned long long>(aligner.corrected()),
+		static_cast<unsigned long long>(aligner.missing()), static_cast<unsigned long long>(aligner.rejected()),
+		static_cast<long long>(us(aligner.offset())));
+
+	auto printLatency = [](const char* what, const cbf::LatencyHistogram& latency) {
+		if (!latency.count()) return;
+		std::printf("%s: p50 <%lldus, p99 <%lldus, max %lldus\n", what,
+			static_cast<long long>(us(latency.percentile(0.5))), static_cast<long long>(us(latency.percentile(0.99))), static_cast<long long>(us(latency.max())));
+	};
+	printLatency("capture thread wakeup to enqueue", source.wakeupLatency);
+	printLatency("kernel timestamp to enqueue", source.eventLatency);
+
+	if (!ageUs.empty()) {
+		std::sort(ageUs.begin(), ageUs.end());
+		std::printf("input age when its frame started: median %lldus, p99 %lldus, max %lldus\n",
+			static_cast<long long>(ageUs[ageUs.size() / 2]), static_cast<long long>(ageUs[ageUs.size() * 99 / 100]), static_cast<long long>(ageUs.back()));
+	}
+
+	// for uinput the send time is known too, so the kernel timestamp itself can be checked
+	// the last frame can miss the last clicks, only matching pairs are compared
+	if (mouse && !applied.empty()) {
+		std::vector<int64_t> stampUs;
+		for (size_t i = 0; i < std::min(sent.size(), applied.size()); i++) stampUs.push_back(us(applied[i] - sent[i]));
+		std::sort(stampUs.begin(), stampUs.end());
+		std::printf("kernel timestamp - send time: min %lldus, median %lldus, max %lldus\n",
+			static_cast<long long>(stampUs.front()), static_cast<long long>(stampUs[stampUs.size() / 2]), static_cast<long long>(stampUs.back()));
+	}
+
+	return 0;
+}
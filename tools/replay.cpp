@@ -0,0 +1,328 @@
+// replays a session recording (see recording.hpp) through a fresh Engine and prints every Step it
+// produces, one line each, so the output of two scheduler versions can be diffed against each other
+// events of all streams are merged back into one timeline by time, an input going in before a game
+// event at the same time. inputs are queued as they were recorded, already aligned
+// times are ns since the first record
+//
+// --export out also writes every applied input with its placement as an input export (input_export.hpp)
+// --check-export file queues an input export back through InputExportPlayer and checks every input
+// lands where the export says it did
+// --validate also runs every replayed frame through TimingValidator, comparing the step split against the
+// old double based one, and prints the largest difference
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "input_export.hpp"
+#include "recording.hpp"
+
+namespace {
+
+struct Totals {
+	uint64_t inputs = 0;
+	uint64_t frames = 0;
+	uint64_t steps = 0;
+	uint64_t subSteps = 0;
+	uint64_t applied = 0;
+	uint64_t mismatches = 0; // frames whose currentFrameTime differs from the recorded one
+};
+
+const char* buttonName(PlayerButton button) {
+	switch (button) {
+	case PlayerButton::Jump: return "jump";
+	case PlayerButton::Left: return "left";
+	case PlayerButton::Right: return "right";
+	default: return "?";
+	}
+}
+
+class Replay {
+public:
+	Replay(bool quiet, cbf::InputExportWriter* exporter, cbf::TimingValidator* validator)
+		: quiet(quiet), exporter(exporter), validator(validator) {}
+
+	void event(const cbf::RecordedEvent& event) {
+		if (origin == cbf::TimestampType {}) origin = event.time;
+
+		switch (event.type) {
+		case cbf::recording::RecordType::Input:
+			engine->addInput(event.input.input, event.stream - 1);
+			totals.inputs++;
+			break;
+		case cbf::recording::RecordType::Loop:
+			engine->cutoffMode = event.cutoffMode;
+			engine->beginLoop(event.time);
+			break;
+		case cbf::recording::RecordType::Reset:
+			engine->reset();
+			if (!quiet) std::printf("reset\n");
+			break;
+		case cbf::recording::RecordType::Suspend:
+			engine->suspend();
+			if (!quiet) std::printf("suspend\n");
+			break;
+		case cbf::recording::RecordType::Frame:
+			frame(event);
+			break;
+		default:
+			break;
+		}
+	}
+
+	const Totals& result() const { return totals; }
+
+private:
+	int64_t at(cbf::TimestampType time) const { return (time - origin).count(); }
+
+	void frame(const cbf::RecordedEvent& event) {
+		const cbf::RecordedFrame& recorded = event.frame;
+		engine->cutoffMode = event.cutoffMode;
+		engine->maxSubSteps = recorded.maxSubSteps;
+		engine->maxExtraPasses = recorded.maxExtraPasses;
+		engine->beginFrame(recorded.stepCount, recorded.dualMode, event.time);
+
+		const bool mismatch = engine->currentFrameTime != recorded.currentFrameTime;
+		totals.mismatches += mismatch;
+		totals.frames++;
+		if (!quiet) {
+			std::printf("frame %" PRIu64 " at %" PRId64 ": %d steps %s, cutoff %" PRId64 "%s, delta %.6f timewarp %.3f%s%s\n",
+				totals.frames, at(event.time), recorded.stepCount, recorded.dualMode ? "dual" : "single", at(engine->currentFrameTime),
+				mismatch ? " (recorded at a different cutoff)" : "", recorded.game.modifiedDelta, recorded.game.timewarp,
+				recorded.game.actualDelta ? " physics bypass" : "", engine->skipUpdate ? " skipped" : "");
+		}
+		if (engine->skipUpdate) return;
+
+		if (validator) {
+			// same inputs the engine took for this frame, like the CBF_VALIDATE_TIMING build does live
+			frameInputs.clear();
+			engine->inputQueue.forEachInBatch([&](const cbf::Input& input) { frameInputs.push_back(input); });
+			const double difference = validator->compareFrame(engine->lastFrameTime, engine->currentFrameTime - engine->lastFrameTime,
+				recorded.stepCount, frameInputs);
+			if (!quiet && !frameInputs.empty()) std::printf("  validate %.9f steps from the old split\n", difference);
+		}
+
+		// like the PlayerObject::update hook: every physics step walks p1's timeline, then p2's
+		for (int i = 0; i < recorded.stepCount; i++) {
+			for (int timeline = 0; timeline < engine->activeTimelines; timeline++) {
+				cbf::Step step;
+				do {
+					step = engine->nextStep(engine->timelines[timeline], [&](const cbf::Input& input, const cbf::InputPlacement& placement) {
+						totals.applied++;
+						if (exporter) exporter->write(*engine, input, placement);
+						if (!quiet) printInput("  apply", input);
+					});
+					totals.steps++;
+					totals.subSteps += !step.endStep;
+					if (!quiet) {
+						std::printf("  p%d step %d +%.9f delta %.9f%s\n", timeline + 1, step.stepIndex, step.stepFraction, step.deltaFactor, step.endStep ? " end" : "");
+					}
+				} while (!step.endStep);
+			}
+		}
+	}
+
+	void printInput(const char* what, const cbf::Input& input) const {
+		std::printf("%s %s %s p%d at %" PRId64 "\n", what, buttonName(input.type), input.state == cbf::InputState::Press ? "press" : "release",
+			static_cast<int>(input.player) + 1, at(input.time));
+	}
+
+	// the engine holds its rings inline, so it lives on the heap
+	std::unique_ptr<cbf::Engine> engine = std::make_unique<cbf::Engine>();
+	cbf::TimestampType origin {};
+	bool quiet;
+	cbf::InputExportWriter* exporter;
+	cbf::TimingValidator* validator;
+	std::vector<cbf::Input> frameInputs;
+	Totals totals;
+};
+
+// the whole file, mapped read only. empty files map to an empty span
+struct MappedFile {
+	void* data = nullptr;
+	size_t size = 0;
+
+	~MappedFile() {
+		if (data) munmap(data, size);
+	}
+
+	bool open(const char* path) {
+		const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+		struct stat info;
+		if (fd < 0 || fstat(fd, &info) != 0) {
+			std::fprintf(stderr, "cant open %s: %s\n", path, std::strerror(errno));
+			if (fd >= 0) close(fd);
+			return false;
+		}
+
+		size = static_cast<size_t>(info.st_size);
+		void* mapped = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+		close(fd);
+		if (mapped == MAP_FAILED) {
+			std::fprintf(stderr, "cant map %s: %s\n", path, std::strerror(errno));
+			return false;
+		}
+		data = mapped;
+		if (data) madvise(data, size, MADV_SEQUENTIAL);
+		return true;
+	}
+
+	std::span<const uint8_t> bytes() const { return std::span(static_cast<const uint8_t*>(data), size); }
+};
+
+bool samePlacement(const cbf::PlacedInput& expected, const cbf::Input& input, const cbf::InputPlacement& placement, uint64_t frame) {
+	// queue times are whole ns, fractions come back within half a ns of a step
+	constexpr double tolerance = 1e-6;
+	return frame == std::max<uint64_t>(expected.placement.frame, 1)
+		&& input.type == expected.input.type && input.state == expected.input.state && input.player == expected.input.player
+		&& placement.stepCount == expected.placement.stepCount && placement.stepIndex == expected.placement.stepIndex
+		&& placement.subStep == expected.placement.subStep
+		&& std::abs(placement.stepFraction - expected.placement.stepFraction) <= tolerance
+		&& std::abs(placement.deltaFactor - expected.placement.deltaFactor) <= tolerance;
+}
+
+int checkExport(const char* path, bool quiet) {
+	MappedFile file;
+	if (!file.open(path)) return 1;
+
+	cbf::InputExportReader reader(file.bytes());
+	if (!reader.valid()) {
+		std::fprintf(stderr, "%s: %s\n", path, reader.error().c_str());
+		return 1;
+	}
+
+	std::vector<cbf::PlacedInput> inputs;
+	cbf::PlacedInput placed;
+	while (reader.next(placed)) inputs.push_back(placed);
+
+	auto engine = std::make_unique<cbf::Engine>();
+	cbf::InputExportPlayer player(inputs);
+	const uint64_t firstFrame = engine->frameNumber + 1;
+
+	size_t applied = 0;
+	uint64_t mismatches = 0;
+	auto apply = [&](const cbf::Input& input, const cbf::InputPlacement& placement) {
+		const uint64_t frame = placement.frame - firstFrame;
+		if (applied >= inputs.size() || !samePlacement(inputs[applied], input, placement, frame)) {
+			mismatches++;
+			if (!quiet) {
+				std::printf("input %zu: frame %" PRIu64 " step %d/%d sub-step %d +%.9f delta %.9f", applied, frame,
+					placement.stepIndex, placement.stepCount, placement.subStep, placement.stepFraction, placement.deltaFactor);
+				if (applied < inputs.size()) {
+					const cbf::InputPlacement& expected = inputs[applied].placement;
+					std::printf(", exported frame %" PRIu64 " step %d/%d sub-step %d +%.9f delta %.9f", expected.frame,
+						expected.stepIndex, expected.stepCount, expected.subStep, expected.stepFraction, expected.deltaFactor);
+				}
+				std::printf("\n");
+			}
+		}
+		applied++;
+	};
+
+	// one frame past the last input, a frame's last step carries its inputs into the next one
+	const uint64_t lastFrame = inputs.empty() ? 0 : inputs.back().placement.frame + 1;
+	while (!player.done() || player.frame() <= lastFrame) {
+		player.beginFrame(*engine);
+		if (engine->skipUpdate) continue;
+
+		const int stepCount = engine->timelines[0].stepGenerator.stepTotal();
+		for (int i = 0; i < stepCount; i++) {
+			for (int timeline = 0; timeline < engine->activeTimelines; timeline++) {
+				while (!engine->nextStep(engine->timelines[timeline], apply).endStep) {}
+			}
+		}
+	}
+
+	std::printf("%zu inputs exported, %zu applied, %" PRIu64 " placed elsewhere%s\n", inputs.size(), applied, mismatches,
+		reader.truncated() ? ", export cut off" : "");
+	return mismatches || applied != inputs.size() ? 2 : 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+	const char* path = nullptr;
+	const char* exportPath = nullptr;
+	const char* checkPath = nullptr;
+	bool quiet = false;
+	bool validate = false;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--quiet")) quiet = true;
+		else if (!std::strcmp(argv[i], "--validate")) validate = true;
+		else if (!std::strcmp(argv[i], "--export") && i + 1 < argc) exportPath = argv[++i];
+		else if (!std::strcmp(argv[i], "--check-export") && i + 1 < argc) checkPath = argv[++i];
+		else if (!path && argv[i][0] != '-') path = argv[i];
+		else usage = true;
+	}
+	if (checkPath && !path && !exportPath && !validate && !usage) return checkExport(checkPath, quiet);
+	if (!path || checkPath || usage) {
+		std::fprintf(stderr, "usage: %s [--quiet] [--validate] [--export out.cbfinput] recording.cbfrec\n"
+			"       %s [--quiet] --check-export export.cbfinput\n", argv[0], argv[0]);
+		return 1;
+	}
+
+	MappedFile file;
+	if (!file.open(path)) return 1;
+
+	cbf::RecordingReader reader(file.bytes());
+	if (!reader.valid()) {
+		std::fprintf(stderr, "%s: %s\n", path, reader.error().c_str());
+		return 1;
+	}
+
+	cbf::InputExportWriter exporter;
+	cbf::TimingValidator validator;
+	Replay replay(quiet, exportPath ? &exporter : nullptr, validate ? &validator : nullptr);
+	if (exportPath) {
+		std::string error;
+		if (!exporter.start(exportPath, 0, error)) {
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+	}
+
+	// k-way merge of the streams, the game stream is last so inputs win ties
+	constexpr size_t streams = cbf::recording::streamCount;
+	cbf::RecordedEvent heads[streams];
+	bool has[streams];
+	for (size_t i = 0; i < streams; i++) has[i] = reader.next(i, heads[i]);
+
+	while (true) {
+		size_t earliest = streams;
+		for (size_t i = 1; i <= streams; i++) {
+			const size_t stream = i % streams;
+			if (has[stream] && (earliest == streams || heads[stream].time < heads[earliest].time)) earliest = stream;
+		}
+		if (earliest == streams) break;
+
+		replay.event(heads[earliest]);
+		has[earliest] = reader.next(earliest, heads[earliest]);
+	}
+
+	const Totals& totals = replay.result();
+	std::printf("%" PRIu64 " frames, %" PRIu64 " inputs queued, %" PRIu64 " applied, %" PRIu64 " steps (%" PRIu64 " sub-steps), %" PRIu64 " frames cut off elsewhere than recorded, %zu damaged chunks\n",
+		totals.frames, totals.inputs, totals.applied, totals.steps, totals.subSteps, totals.mismatches, reader.damagedChunks());
+
+	if (validate) {
+		std::printf("timing validation: max deltaFactor difference vs old split %.9f (%" PRIu64 " inputs compared)\n",
+			validator.maxDifference, validator.inputsCompared);
+	}
+
+	if (exportPath) {
+		exporter.stop();
+		std::printf("%" PRIu64 " inputs exported to %s\n", exporter.inputs(), exportPath);
+	}
+	return 0;
+}
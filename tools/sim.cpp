@@ -0,0 +1,243 @@
+// trace-driven precision simulator for the timing engine
+// runs synthetic frame times and input timestamps through cbf::Engine the same way the game hooks do,
+// and reports how far from its real timestamp each input ended up being applied, in game time.
+// the game clock starts at the wall clock and only moves by the steps the game runs, so the error is split
+// into what the accumulator holds back, the offset between the cutoff window and the loop, and what is left
+// from placing the input in the window (sub-step caps, carrying, stretching the window over fixed steps)
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace {
+
+constexpr int64_t nsPerSecond = 1'000'000'000;
+
+// the sim keeps time as plain nanosecond counts and only wraps them for the engine
+cbf::TimestampType at(int64_t ns) {
+	return cbf::TimestampType(cbf::Duration(ns));
+}
+
+int64_t ns(cbf::TimestampType time) {
+	return time.time_since_epoch().count();
+}
+
+struct SimConfig {
+	double fps = 60.0; // 0 is uncapped
+	cbf::CutoffMode cutoff = cbf::CutoffMode::LoopStart;
+	bool actualDelta = false;
+	uint64_t frames = 1'000'000;
+	double clickRate = 8.0; // inputs per second
+	double frameJitter = 0.05; // standard deviation of frame time, as a fraction of it
+	double physicsDelay = 0.0005; // seconds between the loop start and the physics update
+	uint64_t seed = 1;
+};
+
+struct SimResult {
+	uint64_t framesRun = 0;
+	uint64_t inputs = 0;
+	uint64_t applied = 0;
+	uint64_t delayed = 0; // applied in a later frame than the one their timestamp belongs to
+	uint64_t overflowed = 0;
+	double sumError = 0.0; // signed, applied game time minus the input's timestamp
+	double maxError = 0.0;
+	double sumSquaredError = 0.0;
+	double sumSquaredPlacement = 0.0; // the error without the two offsets below
+	double sumAccumulatorLag = 0.0; // wall time the accumulator hasnt turned into steps yet
+	double sumWindowOffset = 0.0; // from the cutoff window start to the previous loop start
+	double sumLatency = 0.0; // from the input's timestamp to the physics update that applies it
+};
+
+SimResult simulate(const SimConfig& config) {
+	std::mt19937_64 rng(config.seed);
+	std::normal_distribution<double> jitter(1.0, config.frameJitter);
+	std::exponential_distribution<double> clickGap(config.clickRate);
+
+	const double frameTime = config.fps > 0.0 ? 1.0 / config.fps : 1.0 / 1000.0;
+
+	// the engine holds a 1024 slot ring, so it lives on the heap
+	auto engine = std::make_unique<cbf::Engine>();
+	engine->cutoffMode = config.cutoff;
+
+	SimResult result;
+
+	int64_t now = nsPerSecond;
+	int64_t nextInputTime = now + static_cast<int64_t>(clickGap(rng) * nsPerSecond);
+	cbf::InputState nextState = cbf::InputState::Press;
+	double physicsAccumulator = 0.0;
+	double gameTime = static_cast<double>(now); // ns, only moved by the steps the game runs
+
+	// where a frame's steps start in game time and in wall time. the last frame's is kept for the inputs its
+	// final step carried, those are applied in the next frame
+	struct StepMapping {
+		uint64_t frame = 0;
+		double gameStart = 0.0;
+		double stepNs = 0.0;
+		double accumulatorLag = 0.0;
+		double windowOffset = 0.0;
+	};
+	StepMapping mappings[2];
+
+	auto pushInputsUntil = [&](int64_t time) {
+		while (nextInputTime <= time) {
+			if (!engine->inputQueue.push(0, cbf::Input { .time = at(nextInputTime), .state = nextState })) result.overflowed++;
+			result.inputs++;
+			nextState = nextState == cbf::InputState::Press ? cbf::InputState::Release : cbf::InputState::Press;
+			nextInputTime += std::max<int64_t>(1, static_cast<int64_t>(clickGap(rng) * nsPerSecond));
+		}
+	};
+
+	for (uint64_t frame = 0; frame < config.frames; frame++) {
+		const int64_t deltaNs = static_cast<int64_t>(std::max(frameTime * 0.1, frameTime * jitter(rng)) * nsPerSecond);
+		const double delta = static_cast<double>(deltaNs) / nsPerSecond;
+		const int64_t previousLoop = now;
+		now += deltaNs;
+
+		pushInputsUntil(now);
+		engine->beginLoop(at(now));
+
+		// same step count as GJBaseGameLayer::getModifiedDelta, with the game's 240tps accumulator when physics bypass is off
+		int stepCount;
+		if (config.actualDelta) stepCount = static_cast<int>(std::round(std::max(1.0, delta * 240.0)));
+		else {
+			physicsAccumulator += delta;
+			stepCount = static_cast<int>(physicsAccumulator * 240.0);
+			physicsAccumulator -= stepCount / 240.0;
+			if (stepCount == 0) continue;
+		}
+
+		const double gameStepLength = config.actualDelta ? delta / stepCount : 1.0 / 240.0;
+
+		const int64_t physicsTime = now + static_cast<int64_t>(config.physicsDelay * nsPerSecond);
+		pushInputsUntil(physicsTime);
+		engine->beginFrame(stepCount, false, at(physicsTime));
+		// the game still runs its steps on frames the engine skips, just without placing inputs
+		if (engine->skipUpdate) {
+			gameTime += stepCount * gameStepLength * nsPerSecond;
+			continue;
+		}
+		result.framesRun++;
+
+		const int64_t frameStart = ns(engine->lastFrameTime);
+		mappings[1] = mappings[0];
+		mappings[0] = {
+			engine->frameNumber,
+			gameTime,
+			gameStepLength * nsPerSecond,
+			static_cast<double>(previousLoop) - gameTime,
+			static_cast<double>(previousLoop - frameStart)
+		};
+		gameTime += stepCount * gameStepLength * nsPerSecond;
+
+		auto record = [&](const cbf::Input& input, const cbf::InputPlacement& placement) {
+			const StepMapping& mapping = placement.frame == mappings[0].frame ? mappings[0] : mappings[1];
+			const double placed = mapping.gameStart + (placement.stepIndex + placement.stepFraction) * mapping.stepNs;
+			// in us. error = placement - accumulator lag + window offset
+			const double error = (placed - static_cast<double>(ns(input.time))) / 1000.0;
+			const double placementError = error + (mapping.accumulatorLag - mapping.windowOffset) / 1000.0;
+
+			result.applied++;
+			if (ns(input.time) < frameStart) result.delayed++;
+			result.sumError += error;
+			result.sumSquaredError += error * error;
+			result.maxError = std::max(result.maxError, std::abs(error));
+			result.sumSquaredPlacement += placementError * placementError;
+			result.sumAccumulatorLag += mapping.accumulatorLag / 1000.0;
+			result.sumWindowOffset += mapping.windowOffset / 1000.0;
+			result.sumLatency += static_cast<double>(physicsTime - ns(input.time)) / 1000.0;
+		};
+
+		for (int i = 0; i < stepCount; i++) {
+			cbf::Step step;
+			do {
+				step = engine->nextStep(engine->timelines[0], record);
+			} while (!step.endStep);
+		}
+	}
+
+	return result;
+}
+
+void printUsage(const char* name) {
+	std::printf(
+		"usage: %s [--frames N] [--rate inputs/s] [--jitter fraction] [--seed N] [--fps 60,120,...]\n"
+		"runs every fps value with every cutoff mode and physics bypass on and off (fps 0 is uncapped)\n",
+		name
+	);
+}
+
+}
+
+int main(int argc, char** argv) {
+	SimConfig base;
+	std::vector<double> fpsValues = { 60, 80, 120, 144, 240, 360, 0 };
+
+	for (int i = 1; i < argc; i++) {
+		auto next = [&]() -> const char* {
+			if (i + 1 >= argc) {
+				printUsage(argv[0]);
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+
+		if (!std::strcmp(argv[i], "--frames")) base.frames = std::strtoull(next(), nullptr, 10);
+		else if (!std::strcmp(argv[i], "--rate")) base.clickRate = std::strtod(next(), nullptr);
+		else if (!std::strcmp(argv[i], "--jitter")) base.frameJitter = std::strtod(next(), nullptr);
+		else if (!std::strcmp(argv[i], "--seed")) base.seed = std::strtoull(next(), nullptr, 10);
+		else if (!std::strcmp(argv[i], "--fps")) {
+			fpsValues.clear();
+			std::string list = next();
+			for (size_t start = 0; start <= list.size();) {
+				size_t end = list.find(',', start);
+				if (end == std::string::npos) end = list.size();
+				fpsValues.push_back(std::strtod(list.substr(start, end - start).c_str(), nullptr));
+				start = end + 1;
+			}
+		}
+		else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::printf("%8s %8s %5s %10s %10s %10s %8s %8s %11s %11s %11s %11s %11s %11s %11s %8s\n",
+		"fps", "cutoff", "pb", "frames", "inputs", "applied", "delayed", "dropped",
+		"mean us", "rms us", "max us", "place us", "acc us", "window us", "latency us", "sec");
+
+	for (double fps : fpsValues) {
+		for (size_t cutoff = 0; cutoff < static_cast<size_t>(cbf::CutoffMode::Count); cutoff++) {
+			for (int pb = 0; pb < 2; pb++) {
+				SimConfig config = base;
+				config.fps = fps;
+				config.cutoff = static_cast<cbf::CutoffMode>(cutoff);
+				config.actualDelta = pb;
+
+				const auto start = std::chrono::steady_clock::now();
+				const SimResult result = simulate(config);
+				const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				const double applied = std::max<double>(1.0, result.applied);
+				std::printf("%8s %8s %5s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %11.2f %11.2f %11.2f %11.2f %11.2f %11.2f %11.2f %8.2f\n",
+					fps > 0 ? std::to_string(static_cast<int>(fps)).c_str() : "uncapped",
+					cbf::cutoffModeNames[cutoff], pb ? "on" : "off",
+					result.framesRun, result.inputs, result.applied, result.delayed,
+					result.inputs - result.applied,
+					result.sumError / applied, std::sqrt(result.sumSquaredError / applied), result.maxError,
+					std::sqrt(result.sumSquaredPlacement / applied),
+					result.sumAccumulatorLag / applied, result.sumWindowOffset / applied,
+					result.sumLatency / applied, seconds);
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,310 @@
+// realtime stress harness for the input handoff
+// producer threads push inputs at a fixed rate (with jitter and bursts) while a game thread runs
+// beginLoop/beginFrame/nextStep at a fixed fps, the same way clearQueuesBeforeLoop,
+// updateInputQueueAndTime and updateDeltaFactorAndInput drive the engine in the game.
+// every input pushed is accounted for: applied, coalesced, overflowed or lost
+// built with -DCBF_TRACE=ON, --trace writes the producer and game threads out as a chrome trace
+// --record records every rate's session for cbf_replay, into one file per rate
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+#include "input_thread.hpp"
+#include "recording.hpp"
+#include "trace.hpp"
+
+namespace {
+
+struct StressConfig {
+	int producers = 1;
+	double rate = 1000.0; // inputs per second per producer
+	double jitter = 0.1; // standard deviation of the gap between inputs, as a fraction of it
+	int burst = 1; // inputs sent back to back every time
+	double delay = 0.0; // seconds inputs are timestamped before they are queued, like hardware timestamps
+	double fps = 60.0;
+	double seconds = 5.0;
+	cbf::CutoffMode cutoff = cbf::CutoffMode::LoopStart;
+	const char* record = nullptr; // recording path, the rate is appended
+	int maxSubSteps = 48;
+	int maxExtraPasses = 32;
+	uint64_t seed = 1;
+};
+
+struct StressResult {
+	uint64_t pushed = 0;
+	uint64_t overflowed = 0;
+	uint64_t applied = 0;
+	uint64_t coalesced = 0; // duplicate presses/releases the coalescer dropped on purpose
+	uint64_t deferred = 0; // applied in a later frame than the one their timestamp belongs to
+	uint64_t frames = 0;
+	size_t maxDepth = 0; // inputs queued when a frame took its batch
+	size_t maxBatch = 0;
+	double achievedRate = 0.0; // per producer, sleeps overshoot at high rates
+	uint64_t afterCutoff = 0; // queued after their frame had been cut off
+	cbf::Duration cutoffMargin {}; // adaptive mode, mean time between the cutoff and the physics update
+	cbf::LatencyHistogram handoff; // beginFrame, what used to be done under the queue lock
+	std::vector<std::unique_ptr<cbf::LatencyHistogram>> push; // addInput per producer, what used to wait on the lock
+
+	uint64_t lost() const { return pushed - applied - coalesced; }
+};
+
+void producer(cbf::Engine& engine, const StressConfig& config, int index, size_t lane, const std::atomic<bool>& stop,
+	std::atomic<uint64_t>& pushed, cbf::LatencyHistogram& pushTime)
+{
+	std::mt19937_64 rng(config.seed + index);
+	std::normal_distribution<double> jitter(1.0, config.jitter);
+
+	// each producer has a button of its own so the coalescer doesnt see its presses as duplicates of another's
+	const auto player = static_cast<cbf::Player>(index / 3 % 2);
+	const auto button = static_cast<PlayerButton>(index % 3 + 1);
+	auto state = cbf::InputState::Press;
+
+	CBF_TRACE_THREAD("producer");
+	const double gap = config.burst / config.rate;
+	const auto delay = std::chrono::duration_cast<cbf::Duration>(std::chrono::duration<double>(config.delay));
+	auto next = std::chrono::steady_clock::now();
+
+	while (!stop.load(std::memory_order_relaxed)) {
+		next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(0.0, gap * jitter(rng))));
+		std::this_thread::sleep_until(next);
+
+		for (int i = 0; i < config.burst; i++) {
+			const auto start = cbf::getCurrentTime();
+			const cbf::Input input { .time = start - delay, .type = button, .state = state, .player = player };
+			engine.addInput(input, lane, input.time, start);
+			pushTime.record(cbf::getCurrentTime() - start);
+			CBF_TRACE_INSTANT(Input, 1);
+
+			state = state == cbf::InputState::Press ? cbf::InputState::Release : cbf::InputState::Press;
+			pushed.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+// the histograms are atomics, so the result is filled in place
+void stress(const StressConfig& config, StressResult& result) {
+	// the engine holds its lanes and merge ring inline, so it lives on the heap
+	auto engine = std::make_unique<cbf::Engine>();
+	engine->cutoffMode = config.cutoff;
+	engine->maxSubSteps = config.maxSubSteps;
+	engine->maxExtraPasses = config.maxExtraPasses;
+
+	cbf::Recorder recorder;
+	if (config.record) {
+		const std::string path = std::string(config.record) + "." + std::to_string(static_cast<int>(config.rate));
+		std::string error;
+		if (recorder.start(path.c_str(), error)) engine->recorder = &recorder;
+		else std::fprintf(stderr, "%s\n", error.c_str());
+	}
+
+	// the first frame after a reset throws its inputs away on purpose, get it out of the way before producing any
+	engine->beginLoop(cbf::getCurrentTime());
+	engine->beginFrame(4, false, cbf::getCurrentTime());
+
+	std::atomic<bool> stop = false;
+	std::atomic<uint64_t> pushed = 0;
+
+	// the first producer is the platform hook on lane 0, the rest claim lanes like InputSources do
+	std::vector<std::thread> threads;
+	for (int i = 0; i < config.producers; i++) {
+		const auto lane = i == 0 ? std::optional<size_t>(0) : engine->inputQueue.claimLane();
+		if (!lane) {
+			std::fprintf(stderr, "only %zu producers fit in the queue's lanes\n", cbf::inputLanes);
+			break;
+		}
+		result.push.push_back(std::make_unique<cbf::LatencyHistogram>());
+		threads.emplace_back(producer, std::ref(*engine), std::cref(config), i, *lane, std::cref(stop), std::ref(pushed), std::ref(*result.push.back()));
+	}
+
+	const auto frameTime = std::chrono::duration_cast<cbf::Duration>(std::chrono::duration<double>(1.0 / config.fps));
+	const auto physicsDelay = std::chrono::microseconds(500); // between the loop start and the physics update
+	const auto start = cbf::getCurrentTime();
+	const auto end = start + std::chrono::duration_cast<cbf::Duration>(std::chrono::duration<double>(config.seconds));
+	auto nextFrame = start;
+	double physicsAccumulator = 0.0;
+
+	auto runFrame = [&] {
+		nextFrame += frameTime;
+		std::this_thread::sleep_until(std::chrono::steady_clock::time_point(nextFrame.time_since_epoch()));
+
+		engine->beginLoop(cbf::getCurrentTime());
+
+		// the game's 240tps step accumulator, like physics bypass off
+		physicsAccumulator += std::chrono::duration<double>(frameTime).count();
+		const int stepCount = static_cast<int>(physicsAccumulator * 240.0);
+		physicsAccumulator -= stepCount / 240.0;
+		if (stepCount == 0) return;
+
+		std::this_thread::sleep_for(physicsDelay);
+		result.maxDepth = std::max(result.maxDepth, engine->inputQueue.size());
+
+		const auto handoffStart = cbf::getCurrentTime();
+		engine->beginFrame(stepCount, false, cbf::getCurrentTime());
+		result.handoff.record(cbf::getCurrentTime() - handoffStart);
+		result.maxBatch = std::max(result.maxBatch, engine->inputQueue.batchEnd() - engine->inputQueue.batchBegin());
+		result.frames++;
+
+		if (engine->skipUpdate) return;
+
+		const auto frameStart = engine->lastFrameTime;
+		for (int i = 0; i < stepCount; i++) {
+			cbf::Step step;
+			do {
+				CBF_TRACE_SCOPE(SubStep, 1);
+				step = engine->nextStep(engine->timelines[0], [&](const cbf::Input& input) {
+					result.applied++;
+					if (input.time < frameStart) result.deferred++;
+				});
+			} while (!step.endStep);
+		}
+	};
+
+	while (cbf::getCurrentTime() < end) runFrame();
+
+	stop = true;
+	for (auto& thread : threads) thread.join();
+
+	// a few more frames for whatever was still queued
+	for (int i = 0; i < 8 && engine->inputQueue.size(); i++) runFrame();
+	runFrame();
+
+	engine->recorder = nullptr;
+	recorder.stop();
+
+	result.pushed = pushed.load();
+	result.overflowed = engine->inputQueue.overflows();
+	result.coalesced = engine->timelines[0].coalescer.droppedInputs;
+	result.afterCutoff = engine->inputQueue.afterCutoff();
+	result.cutoffMargin = engine->cutoffPredictor.meanCutoffMargin();
+	result.achievedRate = static_cast<double>(result.pushed) / std::max<size_t>(1, threads.size()) / std::chrono::duration<double>(cbf::getCurrentTime() - start).count();
+}
+
+int64_t us(cbf::Duration duration) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+void printUsage(const char* name) {
+	std::printf(
+		"usage: %s [--producers N] [--rate 1000,4000,8000] [--jitter fraction] [--burst N] [--delay us] [--fps FPS] [--trace out.json]\n"
+		"          [--seconds S] [--cutoff loop|late|adaptive] [--max-substeps N] [--max-extra-passes N] [--seed N] [--record out.cbfrec]\n"
+		"runs every rate (inputs/s per producer) for the given time, exits with 1 if any input was lost\n",
+		name
+	);
+}
+
+}
+
+int main(int argc, char** argv) {
+	StressConfig base;
+	std::vector<double> rates = { 1000, 4000, 8000 };
+	const char* tracePath = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		auto next = [&]() -> const char* {
+			if (i + 1 >= argc) {
+				printUsage(argv[0]);
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+
+		if (!std::strcmp(argv[i], "--producers")) base.producers = std::atoi(next());
+		else if (!std::strcmp(argv[i], "--jitter")) base.jitter = std::strtod(next(), nullptr);
+		else if (!std::strcmp(argv[i], "--burst")) base.burst = std::max(1, std::atoi(next()));
+		else if (!std::strcmp(argv[i], "--delay")) base.delay = std::strtod(next(), nullptr) / 1'000'000.0;
+		else if (!std::strcmp(argv[i], "--fps")) base.fps = std::strtod(next(), nullptr);
+		else if (!std::strcmp(argv[i], "--seconds")) base.seconds = std::strtod(next(), nullptr);
+		else if (!std::strcmp(argv[i], "--cutoff")) {
+			const char* mode = next();
+			const auto name = std::find_if(std::begin(cbf::cutoffModeNames), std::end(cbf::cutoffModeNames), [&](const char* name) { return !std::strcmp(name, mode); });
+			if (name == std::end(cbf::cutoffModeNames)) {
+				printUsage(argv[0]);
+				return 1;
+			}
+			base.cutoff = static_cast<cbf::CutoffMode>(name - std::begin(cbf::cutoffModeNames));
+		}
+		else if (!std::strcmp(argv[i], "--max-substeps")) base.maxSubSteps = std::atoi(next());
+		else if (!std::strcmp(argv[i], "--max-extra-passes")) base.maxExtraPasses = std::atoi(next());
+		else if (!std::strcmp(argv[i], "--trace")) tracePath = next();
+		else if (!std::strcmp(argv[i], "--record")) base.record = next();
+		else if (!std::strcmp(argv[i], "--seed")) base.seed = std::strtoull(next(), nullptr, 10);
+		else if (!std::strcmp(argv[i], "--rate")) {
+			rates.clear();
+			std::string list = next();
+			for (size_t start = 0; start <= list.size();) {
+				size_t end = list.find(',', start);
+				if (end == std::string::npos) end = list.size();
+				rates.push_back(std::strtod(list.substr(start, end - start).c_str(), nullptr));
+				start = end + 1;
+			}
+		}
+		else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (base.producers < 1 || base.fps <= 0 || base.seconds <= 0) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	if (tracePath) {
+#ifndef CBF_TRACE
+		std::fprintf(stderr, "built without CBF_TRACE, the trace will be empty\n");
+#endif
+		CBF_TRACE_THREAD("game");
+		std::string error;
+		if (!cbf::trace::Tracer::get().start(tracePath, error)) {
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+	}
+
+	std::printf("%7s %9s %9s %9s %9s %9s %6s %9s %7s %7s %10s %10s %10s %10s\n",
+		"rate", "actual", "pushed", "applied", "coalesced", "overflow", "lost", "deferred", "depth", "batch",
+		"push p99", "push max", "frame p99", "frame max");
+
+	bool anyLost = false;
+	for (double rate : rates) {
+		StressConfig config = base;
+		config.rate = rate;
+
+		StressResult result;
+		stress(config, result);
+		anyLost |= result.lost() != 0;
+
+		cbf::Duration pushP99 {}, pushMax {};
+		for (const auto& push : result.push) {
+			pushP99 = std::max(pushP99, push->percentile(0.99));
+			pushMax = std::max(pushMax, push->max());
+		}
+
+		// p99s are bucket upper bounds, in us
+		std::printf("%7.0f %9.0f %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %6" PRIu64 " %9" PRIu64 " %7zu %7zu %10" PRId64 " %10" PRId64 " %10" PRId64 " %10" PRId64 "\n",
+			rate, result.achievedRate, result.pushed, result.applied, result.coalesced, result.overflowed, result.lost(), result.deferred,
+			result.maxDepth, result.maxBatch, us(pushP99), us(pushMax), us(result.handoff.percentile(0.99)), us(result.handoff.max()));
+		if (config.cutoff == cbf::CutoffMode::Adaptive) {
+			std::printf("        adaptive cutoff %" PRId64 "us before the physics update on average, %" PRIu64 " inputs queued after their cutoff\n",
+				us(result.cutoffMargin), result.afterCutoff);
+		}
+	}
+
+	if (tracePath) {
+		cbf::trace::Tracer::get().stop();
+		std::printf("trace written to %s, %" PRIu64 " records dropped\n", tracePath, cbf::trace::Tracer::get().dropped());
+	}
+
+	return anyLost ? 1 : 0;
+}